@@ -0,0 +1,146 @@
+//===---- astfile.cpp - Rose DNA from serialized clang ASTs ---------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "astfile.h"
+#include "extract.h"
+#include "layout.h"
+#include "trace.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/ExternalASTSource.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Serialization/PCHContainerOperations.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <mutex>
+
+using namespace clang;
+using namespace llvm;
+
+/** Hand the typedefs of \a DC to \a Consumer, and the ones of the extern "C"
+ * blocks and namespaces in it. The declarations are asked for by kind, the
+ * others are never deserialized as DeclContext::decls() would do. */
+static void FindTypedefs(ExternalASTSource *Source, const DeclContext *DC,
+                         TopLevelConsumer &Consumer) {
+  SmallVector<Decl *, 64> Decls;
+  Source->FindExternalLexicalDecls(
+      DC,
+      [](Decl::Kind Kind) {
+        return Kind == Decl::Typedef || Kind == Decl::LinkageSpec ||
+               Kind == Decl::Namespace;
+      },
+      Decls);
+  for (Decl *D : Decls) {
+    if (isa<TypedefDecl>(D)) {
+      Consumer.HandleTopLevelDecl(DeclGroupRef(D));
+    } else {
+      FindTypedefs(Source, cast<DeclContext>(D), Consumer);
+    }
+  }
+}
+
+bool ASTFileExtractor::extract(const std::string &File, SDNA *Shard,
+                               std::vector<std::string> &ShardSources) {
+  llvm::TimeTraceScope Scope("Load AST", File);
+  auto Start = std::chrono::steady_clock::now();
+  auto PCHOperations = std::make_shared<PCHContainerOperations>();
+  IntrusiveRefCntPtr<DiagnosticsEngine> Diags =
+      CompilerInstance::createDiagnostics(new DiagnosticOptions());
+  std::unique_ptr<ASTUnit> Unit = ASTUnit::LoadFromASTFile(
+      File, PCHOperations->getRawReader(), ASTUnit::LoadASTOnly, Diags,
+      FileSystemOptions());
+  if (!Unit) {
+    return false;
+  }
+
+  TypedefExtractor Typedefs(Shard, Headers.empty() ? nullptr : &Headers);
+  TopLevelConsumer Consumer(&Typedefs);
+  if (Headers.empty()) {
+    /** Every typedef is wanted, the records are only deserialized when their
+     * layout is computed. */
+    ASTContext &Context = Unit->getASTContext();
+    if (ExternalASTSource *Source = Context.getExternalSource()) {
+      FindTypedefs(Source, Context.getTranslationUnitDecl(), Consumer);
+      Consumer.flush();
+    } else {
+      Consumer.HandleTranslationUnit(Context);
+    }
+  } else {
+    /** Only the declarations of the DNA headers are deserialized. */
+    FileManager &FM = Unit->getFileManager();
+    SourceManager &SM = Unit->getSourceManager();
+    for (const auto &Header : Headers) {
+      auto Entry = FM.getFile(Header.getKey());
+      if (!Entry) {
+        continue;
+      }
+      FileID ID = SM.translateFile(*Entry);
+      if (ID.isInvalid()) {
+        /** Not part of this AST. */
+        continue;
+      }
+      SmallVector<Decl *, 64> Decls;
+      Unit->findFileRegionDecls(ID, 0, (*Entry)->getSize(), Decls);
+      for (Decl *D : Decls) {
+        Consumer.HandleTopLevelDecl(DeclGroupRef(D));
+      }
+    }
+    Consumer.flush();
+  }
+
+  ShardSources = Typedefs.Sources;
+  if (Stats) {
+    DNAUnitStats UnitStats;
+    UnitStats.File = File;
+    UnitStats.Seconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - Start)
+                            .count();
+    UnitStats.ASTBytes = Unit->getASTContext().getASTAllocatedMemory();
+    UnitStats.Typedefs = Typedefs.Stats;
+    Stats->recordUnit(UnitStats);
+  }
+  return true;
+}
+
+/** Like DNAExtractor::run() the files are loaded by the worker threads and
+ * the shards are merged in the order of \a Files. */
+bool ASTFileExtractor::run(ArrayRef<std::string> Files, SDNA *DNA) {
+  std::vector<SDNA> Shards(Files.size(), SDNA{NULL, 0});
+  std::vector<std::vector<std::string>> ShardSources(Files.size());
+  std::mutex ErrorMutex;
+  bool Success = true;
+
+  {
+    llvm::ThreadPool Pool(llvm::hardware_concurrency(Threads));
+    for (size_t Index = 0; Index < Files.size(); Index++) {
+      Pool.async([&, Index]() {
+        TimeTraceTask Task;
+        if (!extract(Files[Index], &Shards[Index], ShardSources[Index])) {
+          std::lock_guard<std::mutex> Lock(ErrorMutex);
+          llvm::errs() << "Failed to load the AST of " << Files[Index]
+                       << "\n";
+          Success = false;
+        }
+      });
+    }
+    Pool.wait();
+  }
+
+  std::vector<DNAShard> Merged;
+  for (size_t Index = 0; Index < Files.size(); Index++) {
+    Merged.push_back({&Shards[Index], Files[Index], &ShardSources[Index]});
+  }
+  return DNA_merge_shards(Merged, DNA, Sources, Stats) && Success;
+}
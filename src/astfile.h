@@ -0,0 +1,51 @@
+//===---- astfile.h - Rose DNA from serialized clang ASTs -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_ASTFILE_H
+#define ROSE_DNA_ASTFILE_H
+
+#include "dna.h"
+#include "stats.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <string>
+#include <vector>
+
+/** Fills the DNA from precompiled headers and AST files (-emit-ast) instead
+ * of parsing the sources, nothing is lexed nor analyzed again. The AST is
+ * deserialized lazily: with a header set only the top level declarations of
+ * these headers are loaded, without one only the typedefs, namespaces and
+ * extern "C" blocks of every file. Then only the records the typedefs name
+ * are loaded. */
+class ASTFileExtractor {
+public:
+  /** Number of files loaded in parallel, 0 uses every hardware thread. */
+  unsigned Threads = 0;
+  /** When not empty, only the typedefs declared in these files (absolute
+   * paths) are extracted. */
+  llvm::StringSet<> Headers;
+  /** Optional statistics, each file and the merge are recorded in it. */
+  DNAStats *Stats = nullptr;
+
+  /** Extract \a Files in \a DNA, returns false when a file can not be loaded,
+   * an out of date precompiled header included, or when two of them disagree
+   * on the layout of a struct. */
+  bool run(llvm::ArrayRef<std::string> Files, SDNA *DNA);
+
+  /** Absolute path of the file each struct of the last run() is declared
+   * in. */
+  DNASources Sources;
+
+private:
+  bool extract(const std::string &File, SDNA *Shard,
+               std::vector<std::string> &ShardSources);
+};
+
+#endif // ROSE_DNA_ASTFILE_H
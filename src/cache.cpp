@@ -0,0 +1,204 @@
+//===---- cache.cpp - On disk cache of the DNA of translation units -------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "cache.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+using namespace clang::tooling;
+using namespace llvm;
+
+/** Bump this whenever the extraction changes what ends up in the SDNA. */
+static const char CacheVersion[] = "rose-dna-cache-6";
+
+/** Some file systems round the time stamps down, FAT to 2 seconds, a file
+ * stamped this long before a parse may still have been written during it. */
+static const std::chrono::seconds TimeStampSlack(2);
+
+DNACache::DNACache(const std::string &Directory) : Directory(Directory) {}
+
+bool DNACache::init() {
+  return Directory.empty() || !sys::fs::create_directories(Directory);
+}
+
+std::string DNACache::key(const CompilationDatabase &Compilations,
+                          StringRef File, StringRef Salt) const {
+  std::vector<CompileCommand> Commands = Compilations.getCompileCommands(File);
+  if (Commands.empty()) {
+    return std::string();
+  }
+
+  MD5 Hash;
+  Hash.update(StringRef(CacheVersion, sizeof(CacheVersion)));
+  for (const CompileCommand &Command : Commands) {
+    /** Every string is hashed with its terminator so they do not blend. */
+    Hash.update(StringRef(Command.Directory.c_str(),
+                          Command.Directory.size() + 1));
+    Hash.update(StringRef(Command.Filename.c_str(),
+                          Command.Filename.size() + 1));
+    for (const std::string &Argument : Command.CommandLine) {
+      Hash.update(StringRef(Argument.c_str(), Argument.size() + 1));
+    }
+    Hash.update(StringRef("\n", 1));
+  }
+  Hash.update(Salt);
+
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  return Result.digest().str().str();
+}
+
+std::string DNACache::hash(StringRef Path, sys::TimePoint<> *Modified) {
+  sys::fs::file_status Status;
+  if (sys::fs::status(Path, Status)) {
+    return std::string();
+  }
+  if (Modified) {
+    *Modified = Status.getLastModificationTime();
+  }
+
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    auto It = Hashes.find(Path);
+    if (It != Hashes.end() &&
+        It->second.Modified == Status.getLastModificationTime() &&
+        It->second.Size == Status.getSize()) {
+      return It->second.Digest;
+    }
+  }
+
+  std::string Digest;
+  if (auto Buffer = MemoryBuffer::getFile(Path)) {
+    MD5 Hash;
+    Hash.update((*Buffer)->getBuffer());
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    Digest = Result.digest().str().str();
+  }
+
+  /** Written while it was read, the digest matches neither version. */
+  sys::fs::file_status After;
+  if (sys::fs::status(Path, After) ||
+      After.getLastModificationTime() != Status.getLastModificationTime() ||
+      After.getSize() != Status.getSize()) {
+    return std::string();
+  }
+
+  std::lock_guard<std::mutex> Lock(Mutex);
+  Hashes[Path] = {Status.getLastModificationTime(), Status.getSize(), Digest};
+  return Digest;
+}
+
+/** The manifest of an entry has a "<md5> <path>" line per dependency and a
+ * "S <path>" line per struct, the file it is declared in. */
+bool DNACache::load(StringRef Key, SDNA *Shard,
+                    std::vector<std::string> &Sources) {
+  std::string Dependencies;
+  std::vector<unsigned char> Fragment;
+  if (Directory.empty()) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    auto It = Entries.find(Key);
+    if (It == Entries.end()) {
+      return false;
+    }
+    Dependencies = It->second.Dependencies;
+    Fragment = It->second.Fragment;
+  } else {
+    SmallString<256> Path(Directory);
+    sys::path::append(Path, Key + ".deps");
+    auto DependenciesBuffer = MemoryBuffer::getFile(Path);
+    if (!DependenciesBuffer) {
+      return false;
+    }
+    Dependencies = (*DependenciesBuffer)->getBuffer().str();
+
+    sys::path::replace_extension(Path, "dna");
+    auto FragmentBuffer = MemoryBuffer::getFile(Path);
+    if (!FragmentBuffer) {
+      return false;
+    }
+    StringRef Bytes = (*FragmentBuffer)->getBuffer();
+    Fragment.assign(Bytes.bytes_begin(), Bytes.bytes_end());
+  }
+
+  SmallVector<StringRef, 64> Lines;
+  StringRef(Dependencies).split(Lines, '\n', -1, /*KeepEmpty=*/false);
+  std::vector<std::string> EntrySources;
+  for (StringRef Line : Lines) {
+    std::pair<StringRef, StringRef> Entry = Line.split(' ');
+    if (Entry.first == "S") {
+      EntrySources.push_back(Entry.second.str());
+      continue;
+    }
+    if (Entry.first.empty() || Entry.second.empty() ||
+        hash(Entry.second) != Entry.first) {
+      return false;
+    }
+  }
+
+  if (!DNA_read(Shard, Fragment.data(), Fragment.size())) {
+    DNA_free(Shard);
+    return false;
+  }
+  if (EntrySources.size() != (size_t)Shard->_TypesLen) {
+    DNA_free(Shard);
+    return false;
+  }
+  Sources = std::move(EntrySources);
+  return true;
+}
+
+bool DNACache::store(StringRef Key, const SDNA *Shard,
+                     ArrayRef<std::string> Dependencies,
+                     ArrayRef<std::string> Sources,
+                     sys::TimePoint<> Started) {
+  std::string Manifest;
+  for (const std::string &Dependency : Dependencies) {
+    sys::TimePoint<> Modified;
+    std::string Digest = hash(Dependency, &Modified);
+    if (Digest.empty() || Modified >= Started - TimeStampSlack) {
+      return false;
+    }
+    Manifest += Digest + " " + Dependency + "\n";
+  }
+  for (const std::string &Source : Sources) {
+    Manifest += "S " + Source + "\n";
+  }
+
+  std::vector<unsigned char> _BufferOut;
+  DNA_write(Shard, _BufferOut);
+
+  if (Directory.empty()) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Entries[Key] = {std::move(Manifest), std::move(_BufferOut)};
+    return true;
+  }
+
+  /** Written through a temporary file so that a concurrent run never reads a
+   * partial entry. */
+  SmallString<256> Path(Directory);
+  sys::path::append(Path, Key + ".dna");
+  if (Error E = writeFileAtomically(
+          (Path + ".tmp%%%%%%%%").str(), Path,
+          StringRef((const char *)_BufferOut.data(), _BufferOut.size()))) {
+    consumeError(std::move(E));
+    return false;
+  }
+  /** The dependencies are written last, an entry only exists once they are. */
+  sys::path::replace_extension(Path, "deps");
+  if (Error E = writeFileAtomically((Path + ".tmp%%%%%%%%").str(), Path,
+                                    Manifest)) {
+    consumeError(std::move(E));
+    return false;
+  }
+  return true;
+}
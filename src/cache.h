@@ -0,0 +1,85 @@
+//===---- cache.h - On disk cache of the DNA of translation units ---------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_CACHE_H
+#define ROSE_DNA_CACHE_H
+
+#include "dna.h"
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Chrono.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** On disk cache of the SDNA extracted from each translation unit.
+ *
+ * An entry is keyed by the compile commands of the translation unit, it holds
+ * the SDNA of the translation unit and the list of every file it included with
+ * a hash of their contents. An entry is only replayed when none of these files
+ * changed since it was stored. */
+class DNACache {
+public:
+  /** An empty \a Directory keeps the entries in memory, for a resident
+   * rose-dna. */
+  DNACache(const std::string &Directory);
+
+  /** Create the cache directory, returns false when it can not be used. */
+  bool init();
+
+  /** Key of \a File, empty when \a File has no compile command. \a Salt is
+   * hashed in the key too. */
+  std::string key(const clang::tooling::CompilationDatabase &Compilations,
+                  llvm::StringRef File, llvm::StringRef Salt = "") const;
+
+  /** Replay the entry \a Key in \a Shard and the file each of its structs is
+   * declared in in \a Sources, returns false when there is no such entry or
+   * when one of the files it depends on changed. */
+  bool load(llvm::StringRef Key, SDNA *Shard,
+            std::vector<std::string> &Sources);
+  /** Store \a Shard as the entry \a Key, \a Dependencies and \a Sources are
+   * absolute paths, \a Sources has one file per struct of \a Shard.
+   * \a Started is when the parse that built \a Shard began: a dependency
+   * modified since may not be what the parse read, the entry is then not
+   * stored. */
+  bool store(llvm::StringRef Key, const SDNA *Shard,
+             llvm::ArrayRef<std::string> Dependencies,
+             llvm::ArrayRef<std::string> Sources,
+             llvm::sys::TimePoint<> Started);
+
+private:
+  /** Hash of the contents of \a Path, empty when it can not be read or when
+   * it changed while it was read. It is only computed again when the size or
+   * the time stamp of \a Path change, \a Modified receives that time stamp.
+   */
+  std::string hash(llvm::StringRef Path,
+                   llvm::sys::TimePoint<> *Modified = nullptr);
+
+  struct FileHash {
+    llvm::sys::TimePoint<> Modified;
+    uint64_t Size;
+    std::string Digest;
+  };
+
+  struct MemoryEntry {
+    std::string Dependencies;
+    std::vector<unsigned char> Fragment;
+  };
+
+  std::string Directory;
+
+  std::mutex Mutex;
+  llvm::StringMap<FileHash> Hashes;
+  llvm::StringMap<MemoryEntry> Entries;
+};
+
+#endif // ROSE_DNA_CACHE_H
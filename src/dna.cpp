@@ -0,0 +1,1185 @@
+//===---- dna.cpp - In memory representation of rose DNA ------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "dna.h"
+#include "dna_format.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+/** Make room for \a Len + \a Count elements in \a Array, doubling its
+ * capacity \a Cap. */
+template <typename T>
+static bool DNA_reserve(T **Array, int *Cap, int Len, int Count) {
+  if (Len + Count <= *Cap) {
+    return true;
+  }
+  int NewCap = *Cap ? *Cap : 16;
+  while (NewCap < Len + Count) {
+    NewCap *= 2;
+  }
+  T *arr = (T *)realloc(*Array, sizeof(T) * NewCap);
+  if (!arr) {
+    return false;
+  }
+  *Array = arr;
+  *Cap = NewCap;
+  return true;
+}
+
+static inline uint64_t DNA_hash(uint64_t hash, const void *data, size_t size) {
+  /** FNV-1a, good enough to tell layouts apart and stable across runs. */
+  const unsigned char *raw = (const unsigned char *)data;
+  for (const unsigned char *itr = raw; itr != raw + size; itr++) {
+    hash = (hash ^ *itr) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static inline uint64_t DNA_hash_int(uint64_t hash, int value) {
+  return DNA_hash(hash, &value, sizeof(value));
+}
+
+static inline uint64_t DNA_hash_string(uint64_t hash, const char *str) {
+  /** Include the terminator so that consecutive strings do not blend. */
+  return DNA_hash(hash, str, strlen(str)) * 0x100000001b3ULL;
+}
+
+/** Slot of \a String in the index of the strings, free when not found. */
+static int *DNA_string_slot(const SDNA *DNA, const char *String,
+                            size_t Length) {
+  size_t Mask = DNA->_StringsIndexCap - 1;
+  size_t Slot = DNA_hash(0xcbf29ce484222325ULL, String, Length) & Mask;
+  while (true) {
+    int *Offset = &DNA->_StringsIndex[Slot];
+    if (*Offset == 0 || (strncmp(DNA->_Strings + *Offset, String, Length) == 0 &&
+                         DNA->_Strings[*Offset + Length] == '\0')) {
+      return Offset;
+    }
+    Slot = (Slot + 1) & Mask;
+  }
+}
+
+/** Double the index of the strings, it is kept at most half full. */
+static bool DNA_grow_string_index(SDNA *DNA) {
+  int OldCap = DNA->_StringsIndexCap;
+  int *Old = DNA->_StringsIndex;
+  int NewCap = OldCap ? OldCap * 2 : 64;
+  int *Index = (int *)calloc(NewCap, sizeof(int));
+  if (!Index) {
+    return false;
+  }
+  DNA->_StringsIndex = Index;
+  DNA->_StringsIndexCap = NewCap;
+  for (int Slot = 0; Slot < OldCap; Slot++) {
+    if (Old[Slot]) {
+      const char *String = DNA->_Strings + Old[Slot];
+      *DNA_string_slot(DNA, String, strlen(String)) = Old[Slot];
+    }
+  }
+  free(Old);
+  return true;
+}
+
+int DNA_intern(SDNA *DNA, const char *String, size_t Length) {
+  if (Length == 0) {
+    return 0;
+  }
+  if (!DNA->_Strings) {
+    /** The empty string. */
+    if (!DNA_reserve(&DNA->_Strings, &DNA->_StringsCap, 0, 1)) {
+      return -1;
+    }
+    DNA->_Strings[DNA->_StringsLen++] = '\0';
+  }
+  if ((DNA->_StringsIndexLen + 1) * 2 > DNA->_StringsIndexCap &&
+      !DNA_grow_string_index(DNA)) {
+    return -1;
+  }
+
+  int *Slot = DNA_string_slot(DNA, String, Length);
+  if (*Slot) {
+    return *Slot;
+  }
+  if ((size_t)DNA->_StringsLen + Length + 1 > (size_t)INT32_MAX ||
+      !DNA_reserve(&DNA->_Strings, &DNA->_StringsCap, DNA->_StringsLen,
+                   (int)Length + 1)) {
+    return -1;
+  }
+  int Offset = DNA->_StringsLen;
+  memcpy(DNA->_Strings + Offset, String, Length);
+  DNA->_Strings[Offset + Length] = '\0';
+  DNA->_StringsLen += (int)Length + 1;
+
+  *Slot = Offset;
+  DNA->_StringsIndexLen++;
+  return Offset;
+}
+
+const char *DNA_primitive_name(int Primitive) {
+  static const char *const Names[DNA_PRIMITIVE_COUNT] = {
+      "void",    "bool",    "int8",    "uint8",   "int16",   "uint16",
+      "int32",   "uint32",  "int64",   "uint64",  "int128",  "uint128",
+      "float16", "float32", "float64", "float80", "float128", "pointer",
+  };
+  if (Primitive < 0 || Primitive >= DNA_PRIMITIVE_COUNT) {
+    return "";
+  }
+  return Names[Primitive];
+}
+
+int DNA_primitive_integer(bool Signed, int Size) {
+  int Primitive;
+  switch (Size) {
+  case 1:
+    Primitive = DNA_PRIMITIVE_INT8;
+    break;
+  case 2:
+    Primitive = DNA_PRIMITIVE_INT16;
+    break;
+  case 4:
+    Primitive = DNA_PRIMITIVE_INT32;
+    break;
+  case 8:
+    Primitive = DNA_PRIMITIVE_INT64;
+    break;
+  case 16:
+    Primitive = DNA_PRIMITIVE_INT128;
+    break;
+  default:
+    return -1;
+  }
+  /** Every unsigned integer follows its signed one. */
+  return Signed ? Primitive : Primitive + 1;
+}
+
+/** Slot of the type \a kind named \a name in the index of the types, free
+ * when not found. */
+static int *DNA_type_slot(const SDNA *DNA, int kind, int name) {
+  size_t Mask = DNA->_TypeTableIndexCap - 1;
+  size_t Slot =
+      DNA_hash_int(DNA_hash_int(0xcbf29ce484222325ULL, kind), name) & Mask;
+  while (true) {
+    int *Id = &DNA->_TypeTableIndex[Slot];
+    if (*Id == 0 || (DNA->_TypeTable[*Id - 1].kind == kind &&
+                     DNA->_TypeTable[*Id - 1].name == name)) {
+      return Id;
+    }
+    Slot = (Slot + 1) & Mask;
+  }
+}
+
+/** Double the index of the types, it is kept at most half full. */
+static bool DNA_grow_type_index(SDNA *DNA) {
+  int NewCap = DNA->_TypeTableIndexCap ? DNA->_TypeTableIndexCap * 2 : 64;
+  int *Index = (int *)calloc(NewCap, sizeof(int));
+  if (!Index) {
+    return false;
+  }
+  free(DNA->_TypeTableIndex);
+  DNA->_TypeTableIndex = Index;
+  DNA->_TypeTableIndexCap = NewCap;
+  for (int Id = 0; Id < DNA->_TypeTableLen; Id++) {
+    const DNAType *Type = &DNA->_TypeTable[Id];
+    *DNA_type_slot(DNA, Type->kind, Type->name) = Id + 1;
+  }
+  return true;
+}
+
+int DNA_add_type(SDNA *DNA, int kind, const std::string &name, int size,
+                 int index) {
+  const char *Name =
+      kind == DNA_TYPE_PRIMITIVE ? DNA_primitive_name(index) : name.c_str();
+  int NameOffset = DNA_intern(DNA, Name, strlen(Name));
+  if (NameOffset < 0) {
+    return -1;
+  }
+  if ((DNA->_TypeTableLen + 1) * 2 > DNA->_TypeTableIndexCap &&
+      !DNA_grow_type_index(DNA)) {
+    return -1;
+  }
+
+  int *Slot = DNA_type_slot(DNA, kind, NameOffset);
+  if (*Slot) {
+    DNAType *Type = &DNA->_TypeTable[*Slot - 1];
+    if (!Type->size) {
+      /** A record may only be complete in some translation units. */
+      Type->size = size;
+    }
+    return *Slot - 1;
+  }
+  if (!DNA_reserve(&DNA->_TypeTable, &DNA->_TypeTableCap, DNA->_TypeTableLen,
+                   1)) {
+    return -1;
+  }
+  DNAType *Type = &DNA->_TypeTable[DNA->_TypeTableLen++];
+  Type->name = NameOffset;
+  Type->kind = kind;
+  Type->size = size;
+  Type->index = kind == DNA_TYPE_STRUCT ? -1 : index;
+  *Slot = DNA->_TypeTableLen;
+  return DNA->_TypeTableLen - 1;
+}
+
+/** The struct each type of \a DNA refers to, the first struct with its name,
+ * and the index of the other types as they are. */
+static std::vector<int> DNA_type_indices(const SDNA *DNA) {
+  std::unordered_map<int, int> Structs;
+  for (int StructIndex = 0; StructIndex < DNA->_TypesLen; StructIndex++) {
+    /** Strings are interned, the name of a type is the name of its struct. */
+    Structs.emplace(DNA->_Types[StructIndex].name, StructIndex);
+  }
+  std::vector<int> Indices(DNA->_TypeTableLen);
+  for (int Id = 0; Id < DNA->_TypeTableLen; Id++) {
+    const DNAType *Type = &DNA->_TypeTable[Id];
+    Indices[Id] = Type->index;
+    if (Type->kind == DNA_TYPE_STRUCT) {
+      auto It = Structs.find(Type->name);
+      Indices[Id] = It != Structs.end() ? It->second : -1;
+    }
+  }
+  return Indices;
+}
+
+void DNA_resolve_types(SDNA *DNA) {
+  std::vector<int> Indices = DNA_type_indices(DNA);
+  for (int Id = 0; Id < DNA->_TypeTableLen; Id++) {
+    DNA->_TypeTable[Id].index = Indices[Id];
+  }
+}
+
+DNAStruct *DNA_add_struct(SDNA *DNA, const std::string &name) {
+  int Name = DNA_intern(DNA, name.c_str(), name.size());
+  if (Name < 0 ||
+      !DNA_reserve(&DNA->_Types, &DNA->_TypesCap, DNA->_TypesLen, 1)) {
+    return NULL;
+  }
+  DNAStruct *Struct = &DNA->_Types[DNA->_TypesLen++];
+  memset(Struct, 0, sizeof(DNAStruct));
+  Struct->name = Name;
+  Struct->_FieldsIndex = DNA->_FieldsLen;
+  return Struct;
+}
+
+DNAField *DNA_add_field(SDNA *DNA, DNAStruct *Struct, const std::string &name) {
+  if (Struct != DNA->_Types + DNA->_TypesLen - 1) {
+    /** The fields of the other structs would no longer be contiguous. */
+    return NULL;
+  }
+  int Name = DNA_intern(DNA, name.c_str(), name.size());
+  if (Name < 0 ||
+      !DNA_reserve(&DNA->_Fields, &DNA->_FieldsCap, DNA->_FieldsLen, 1)) {
+    return NULL;
+  }
+  DNAField *Field = &DNA->_Fields[DNA->_FieldsLen++];
+  memset(Field, 0, sizeof(DNAField));
+  Field->name = Name;
+  Field->type_id = -1;
+  Struct->_FieldsLen++;
+  return Field;
+}
+
+DNAStruct *DNA_copy_struct(SDNA *DNA, const SDNA *From,
+                           const DNAStruct *Struct) {
+  DNAStruct *Copy = DNA_add_struct(DNA, DNA_string(From, Struct->name));
+  if (!Copy) {
+    return NULL;
+  }
+  Copy->size = Struct->size;
+  const DNAField *Fields = DNA_struct_fields(From, Struct);
+  for (const DNAField *Field = Fields; Field != Fields + Struct->_FieldsLen;
+       ++Field) {
+    DNAField *FieldCopy =
+        DNA_add_field(DNA, Copy, DNA_string(From, Field->name));
+    if (!FieldCopy) {
+      return NULL;
+    }
+    const char *Type = DNA_string(From, Field->type);
+    int Name = FieldCopy->name;
+    *FieldCopy = *Field;
+    FieldCopy->name = Name;
+    FieldCopy->type = DNA_intern(DNA, Type, strlen(Type));
+    if (FieldCopy->type < 0) {
+      return NULL;
+    }
+    if (Field->type_id >= 0) {
+      const DNAType *Resolved = &From->_TypeTable[Field->type_id];
+      FieldCopy->type_id =
+          DNA_add_type(DNA, Resolved->kind, DNA_string(From, Resolved->name),
+                       Resolved->size, Resolved->index);
+      if (FieldCopy->type_id < 0) {
+        return NULL;
+      }
+    }
+  }
+  return Copy;
+}
+
+uint64_t DNA_struct_fingerprint(const SDNA *DNA, const DNAStruct *Struct) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = DNA_hash_int(hash, Struct->size);
+  hash = DNA_hash_int(hash, Struct->_FieldsLen);
+  const DNAField *Fields = DNA_struct_fields(DNA, Struct);
+  for (const DNAField *Field = Fields; Field != Fields + Struct->_FieldsLen;
+       ++Field) {
+    hash = DNA_hash_string(hash, DNA_string(DNA, Field->name));
+    hash = DNA_hash_string(hash, DNA_string(DNA, Field->type));
+    hash = DNA_hash_int(hash, Field->offset);
+    hash = DNA_hash_int(hash, Field->size);
+    hash = DNA_hash_int(hash, Field->align);
+    hash = DNA_hash_int(hash, Field->array);
+    hash = DNA_hash_int(hash, Field->flags);
+  }
+  return hash;
+}
+
+void DNA_clear(SDNA *DNA) {
+  DNA->_TypesLen = 0;
+  DNA->_FieldsLen = 0;
+  /** The empty string stays. */
+  DNA->_StringsLen = DNA->_Strings ? 1 : 0;
+  if (DNA->_StringsIndex) {
+    memset(DNA->_StringsIndex, 0, sizeof(int) * DNA->_StringsIndexCap);
+  }
+  DNA->_StringsIndexLen = 0;
+  DNA->_TypeTableLen = 0;
+  if (DNA->_TypeTableIndex) {
+    memset(DNA->_TypeTableIndex, 0, sizeof(int) * DNA->_TypeTableIndexCap);
+  }
+}
+
+void DNA_free(SDNA *DNA) {
+  free(DNA->_Types);
+  free(DNA->_Fields);
+  free(DNA->_Strings);
+  free(DNA->_StringsIndex);
+  free(DNA->_TypeTable);
+  free(DNA->_TypeTableIndex);
+  memset(DNA, 0, sizeof(SDNA));
+}
+
+DNAMerger::DNAMerger(SDNA *DNA) : DNA(DNA) {}
+
+bool DNAMerger::merge(SDNA *Shard, const std::string &Origin,
+                      const std::vector<std::string> *ShardSources) {
+  bool Success = true;
+  int OriginIndex = -1;
+  for (const DNAStruct *Struct = Shard->_Types;
+       Struct != Shard->_Types + Shard->_TypesLen; ++Struct) {
+    std::string Name(DNA_string(Shard, Struct->name));
+    uint64_t Fingerprint = DNA_struct_fingerprint(Shard, Struct);
+
+    auto It = Index.find(Name);
+    if (It == Index.end()) {
+      if (!DNA_copy_struct(DNA, Shard, Struct)) {
+        Success = false;
+        break;
+      }
+      if (OriginIndex < 0) {
+        OriginIndex = (int)Origins.size();
+        Origins.push_back(Origin);
+      }
+      Index.emplace(Name, Entry{Fingerprint, OriginIndex});
+      size_t StructIndex = Struct - Shard->_Types;
+      if (ShardSources && StructIndex < ShardSources->size()) {
+        Sources[Name] = (*ShardSources)[StructIndex];
+      }
+      continue;
+    }
+
+    if (It->second.Fingerprint != Fingerprint) {
+      Conflicts.push_back({Name, Origins[It->second.Origin], Origin});
+    }
+  }
+
+  DNA_free(Shard);
+  return Success;
+}
+
+/** Does not include the null terminator */
+void WriteWordOut(std::vector<unsigned char> &Buffer, const std::string &Word) {
+  unsigned char *raw = (unsigned char *)Word.c_str();
+  for (unsigned char *itr = raw; itr != raw + Word.size(); itr++) {
+    Buffer.push_back(*itr);
+  }
+}
+
+/** Does include the null terminator */
+void WriteStringOut(std::vector<unsigned char> &Buffer, const std::string &Word) {
+  unsigned char *raw = (unsigned char *)Word.c_str();
+  for (unsigned char *itr = raw; itr != raw + Word.size(); itr++) {
+    Buffer.push_back(*itr);
+  }
+  Buffer.push_back((unsigned char)'\0');
+}
+
+void WriteIntOut(std::vector<unsigned char> &Buffer, int value) {
+  unsigned char *raw = (unsigned char *)&value;
+  for (unsigned char *itr = raw; itr != raw + sizeof(value); itr++) {
+    Buffer.push_back(*itr);
+  }
+}
+
+void DNA_write_struct(const SDNA *DNA, const DNAStruct *Struct,
+                      std::vector<unsigned char> &_BufferOut) {
+  WriteStringOut(_BufferOut, DNA_string(DNA, Struct->name));
+  WriteIntOut(_BufferOut, Struct->size);
+
+  WriteIntOut(_BufferOut, Struct->_FieldsLen);
+  const DNAField *Fields = DNA_struct_fields(DNA, Struct);
+  for (const DNAField *Field = Fields; Field != Fields + Struct->_FieldsLen;
+       ++Field) {
+    WriteStringOut(_BufferOut, DNA_string(DNA, Field->name));
+    WriteStringOut(_BufferOut, DNA_string(DNA, Field->type));
+    WriteIntOut(_BufferOut, Field->offset);
+    WriteIntOut(_BufferOut, Field->size);
+    WriteIntOut(_BufferOut, Field->align);
+    WriteIntOut(_BufferOut, Field->array);
+    WriteIntOut(_BufferOut, Field->flags);
+  }
+}
+
+void DNA_write(const SDNA *DNA, std::vector<unsigned char> &_BufferOut) {
+  /** Can be read as int32, to recognize the endianess. */
+  WriteWordOut(_BufferOut, "SDNA");
+
+  WriteIntOut(_BufferOut, DNA->_TypesLen);
+  for (DNAStruct *Struct = DNA->_Types; Struct != DNA->_Types + DNA->_TypesLen;
+       ++Struct) {
+    DNA_write_struct(DNA, Struct, _BufferOut);
+  }
+
+  /** Readers unaware of the types stop after the structs. */
+  WriteWordOut(_BufferOut, "TYPE");
+  std::vector<int> Indices = DNA_type_indices(DNA);
+  WriteIntOut(_BufferOut, DNA->_TypeTableLen);
+  for (int Id = 0; Id < DNA->_TypeTableLen; Id++) {
+    const DNAType *Type = &DNA->_TypeTable[Id];
+    WriteStringOut(_BufferOut, DNA_string(DNA, Type->name));
+    WriteIntOut(_BufferOut, Type->kind);
+    WriteIntOut(_BufferOut, Type->size);
+    WriteIntOut(_BufferOut, Indices[Id]);
+  }
+  int FieldsLen = 0;
+  for (DNAStruct *Struct = DNA->_Types; Struct != DNA->_Types + DNA->_TypesLen;
+       ++Struct) {
+    FieldsLen += Struct->_FieldsLen;
+  }
+  WriteIntOut(_BufferOut, FieldsLen);
+  for (DNAStruct *Struct = DNA->_Types; Struct != DNA->_Types + DNA->_TypesLen;
+       ++Struct) {
+    const DNAField *Fields = DNA_struct_fields(DNA, Struct);
+    for (const DNAField *Field = Fields; Field != Fields + Struct->_FieldsLen;
+         ++Field) {
+      WriteIntOut(_BufferOut, Field->type_id);
+    }
+  }
+}
+
+DNAStreamWriter::DNAStreamWriter() { memset(&Written, 0, sizeof(SDNA)); }
+
+DNAStreamWriter::~DNAStreamWriter() { DNA_free(&Written); }
+
+void DNAStreamWriter::begin(std::vector<unsigned char> &_BufferOut) {
+  WriteWordOut(_BufferOut, "SDNA");
+  WriteIntOut(_BufferOut, 0);
+}
+
+bool DNAStreamWriter::add(const SDNA *DNA, const DNAStruct *Struct,
+                          std::vector<unsigned char> &_BufferOut) {
+  /** The name is all DNA_type_indices() needs of a struct. */
+  if (!DNA_add_struct(&Written, DNA_string(DNA, Struct->name))) {
+    return false;
+  }
+  const DNAField *Fields = DNA_struct_fields(DNA, Struct);
+  for (const DNAField *Field = Fields; Field != Fields + Struct->_FieldsLen;
+       ++Field) {
+    int Id = -1;
+    if (Field->type_id >= 0) {
+      const DNAType *Type = &DNA->_TypeTable[Field->type_id];
+      Id = DNA_add_type(&Written, Type->kind, DNA_string(DNA, Type->name),
+                        Type->size, Type->index);
+      if (Id < 0) {
+        return false;
+      }
+    }
+    FieldTypes.push_back(Id);
+  }
+  DNA_write_struct(DNA, Struct, _BufferOut);
+  return true;
+}
+
+int DNAStreamWriter::finish(std::vector<unsigned char> &_BufferOut) {
+  /** The same section as DNA_write(). */
+  WriteWordOut(_BufferOut, "TYPE");
+  std::vector<int> Indices = DNA_type_indices(&Written);
+  WriteIntOut(_BufferOut, Written._TypeTableLen);
+  for (int Id = 0; Id < Written._TypeTableLen; Id++) {
+    const DNAType *Type = &Written._TypeTable[Id];
+    WriteStringOut(_BufferOut, DNA_string(&Written, Type->name));
+    WriteIntOut(_BufferOut, Type->kind);
+    WriteIntOut(_BufferOut, Type->size);
+    WriteIntOut(_BufferOut, Indices[Id]);
+  }
+  WriteIntOut(_BufferOut, (int)FieldTypes.size());
+  for (int Id : FieldTypes) {
+    WriteIntOut(_BufferOut, Id);
+  }
+  return Written._TypesLen;
+}
+
+void DNA_write_targets(const std::vector<DNATarget> &Targets,
+                       std::vector<unsigned char> &_BufferOut) {
+  if (Targets.empty()) {
+    return;
+  }
+  DNA_write(&Targets.front().DNA, _BufferOut);
+
+  WriteWordOut(_BufferOut, "TRGT");
+  WriteIntOut(_BufferOut, (int)Targets.size());
+  WriteStringOut(_BufferOut, Targets.front().Triple);
+  for (auto Target = Targets.begin() + 1; Target != Targets.end(); ++Target) {
+    WriteStringOut(_BufferOut, Target->Triple);
+    DNA_write(&Target->DNA, _BufferOut);
+  }
+}
+
+/** Append the bytes of \a Value, integers are in the byte order of the
+ * machine. */
+template <typename T>
+static void WriteRawOut(std::vector<unsigned char> &Buffer, const T &Value) {
+  const unsigned char *raw = (const unsigned char *)&Value;
+  Buffer.insert(Buffer.end(), raw, raw + sizeof(Value));
+}
+
+/** The sections of one target, built before their offsets are known. */
+typedef struct DNAIndexedSection {
+  DNAFileSection Section;
+  std::vector<unsigned char> Data;
+} DNAIndexedSection;
+
+static void DNA_write_indexed_target(const DNATarget &Target, uint32_t Index,
+                                     std::vector<DNAIndexedSection> &Sections,
+                                     std::vector<DNAFileTarget> &Triples) {
+  const SDNA *DNA = &Target.DNA;
+  DNAIndexedSection Strings = {{DNA_SECTION_STRINGS, Index, 0, 0, 0, 1}, {}};
+  if (DNA->_Strings) {
+    Strings.Data.assign(DNA->_Strings, DNA->_Strings + DNA->_StringsLen);
+  } else {
+    Strings.Data.push_back('\0');
+  }
+  DNAFileTarget Triple = {0, 0};
+  if (!Target.Triple.empty()) {
+    Triple.triple = (uint32_t)Strings.Data.size();
+    WriteStringOut(Strings.Data, Target.Triple);
+  }
+  Triples.push_back(Triple);
+
+  DNAIndexedSection Structs = {
+      {DNA_SECTION_STRUCTS, Index, 0, 0, 0, sizeof(DNAFileStruct)}, {}};
+  DNAIndexedSection Fields = {
+      {DNA_SECTION_FIELDS, Index, 0, 0, 0, sizeof(DNAFileField)}, {}};
+  uint32_t FieldsLen = 0;
+  for (const DNAStruct *Struct = DNA->_Types;
+       Struct != DNA->_Types + DNA->_TypesLen; ++Struct) {
+    /** The fields are written in the order of the structs. */
+    DNAFileStruct FileStruct = {(uint32_t)Struct->name, Struct->size,
+                                FieldsLen, (uint32_t)Struct->_FieldsLen};
+    WriteRawOut(Structs.Data, FileStruct);
+    const DNAField *StructFields = DNA_struct_fields(DNA, Struct);
+    for (const DNAField *Field = StructFields;
+         Field != StructFields + Struct->_FieldsLen; ++Field) {
+      DNAFileField FileField = {(uint32_t)Field->name, (uint32_t)Field->type,
+                                Field->type_id,        Field->offset,
+                                Field->size,           Field->align,
+                                Field->array,          (uint32_t)Field->flags};
+      WriteRawOut(Fields.Data, FileField);
+    }
+    FieldsLen += Struct->_FieldsLen;
+  }
+  Structs.Section.count = DNA->_TypesLen;
+  Fields.Section.count = FieldsLen;
+
+  DNAIndexedSection Types = {
+      {DNA_SECTION_TYPES, Index, 0, 0, 0, sizeof(DNAFileType)}, {}};
+  std::vector<int> Indices = DNA_type_indices(DNA);
+  for (int Id = 0; Id < DNA->_TypeTableLen; Id++) {
+    const DNAType *Type = &DNA->_TypeTable[Id];
+    DNAFileType FileType = {(uint32_t)Type->name, (uint32_t)Type->kind,
+                            Type->size, Indices[Id]};
+    WriteRawOut(Types.Data, FileType);
+  }
+  Types.Section.count = DNA->_TypeTableLen;
+
+  /** At most half full, the first struct of a name wins. */
+  uint32_t SlotsLen = 1;
+  while (SlotsLen < 2 * (uint32_t)DNA->_TypesLen) {
+    SlotsLen *= 2;
+  }
+  std::vector<uint32_t> Slots(SlotsLen, 0);
+  for (int StructIndex = 0; StructIndex < DNA->_TypesLen; StructIndex++) {
+    int Name = DNA->_Types[StructIndex].name;
+    const char *String = DNA_string(DNA, Name);
+    uint32_t Slot = DNA_format_hash(String, strlen(String)) & (SlotsLen - 1);
+    while (Slots[Slot] && DNA->_Types[Slots[Slot] - 1].name != Name) {
+      Slot = (Slot + 1) & (SlotsLen - 1);
+    }
+    if (!Slots[Slot]) {
+      Slots[Slot] = StructIndex + 1;
+    }
+  }
+  DNAIndexedSection Names = {
+      {DNA_SECTION_NAMES, Index, 0, 0, SlotsLen, sizeof(uint32_t)}, {}};
+  for (uint32_t Slot : Slots) {
+    WriteRawOut(Names.Data, Slot);
+  }
+
+  Strings.Section.count = (uint32_t)Strings.Data.size();
+  Sections.push_back(std::move(Strings));
+  Sections.push_back(std::move(Structs));
+  Sections.push_back(std::move(Fields));
+  Sections.push_back(std::move(Types));
+  Sections.push_back(std::move(Names));
+}
+
+static uint64_t DNA_align(uint64_t Offset) {
+  return (Offset + DNA_FORMAT_ALIGN - 1) & ~(uint64_t)(DNA_FORMAT_ALIGN - 1);
+}
+
+void DNA_write_indexed(const std::vector<DNATarget> &Targets,
+                       std::vector<unsigned char> &_BufferOut) {
+  std::vector<DNAIndexedSection> Sections(1);
+  std::vector<DNAFileTarget> Triples;
+  for (uint32_t Index = 0; Index < Targets.size(); Index++) {
+    DNA_write_indexed_target(Targets[Index], Index, Sections, Triples);
+  }
+  Sections[0].Section = {DNA_SECTION_TARGETS, 0, 0, 0,
+                         (uint32_t)Triples.size(), sizeof(DNAFileTarget)};
+  for (const DNAFileTarget &Triple : Triples) {
+    WriteRawOut(Sections[0].Data, Triple);
+  }
+
+  uint64_t Offset = DNA_align(sizeof(DNAFileHeader) +
+                              Sections.size() * sizeof(DNAFileSection));
+  for (DNAIndexedSection &Section : Sections) {
+    Section.Section.offset = Offset;
+    Section.Section.size = Section.Data.size();
+    Offset = DNA_align(Offset + Section.Data.size());
+  }
+
+  DNAFileHeader Header;
+  memset(&Header, 0, sizeof(Header));
+  memcpy(Header.magic, DNA_FORMAT_MAGIC, sizeof(Header.magic));
+  Header.version = DNA_FORMAT_VERSION;
+  Header.byte_order = DNA_FORMAT_BYTE_ORDER;
+  Header.header_size = sizeof(DNAFileHeader);
+  Header.file_size = Offset;
+  Header.sections_offset = sizeof(DNAFileHeader);
+  Header.sections_len = (uint32_t)Sections.size();
+  Header.targets_len = (uint32_t)Targets.size();
+
+  size_t Base = _BufferOut.size();
+  _BufferOut.reserve(Base + Offset);
+  WriteRawOut(_BufferOut, Header);
+  for (const DNAIndexedSection &Section : Sections) {
+    WriteRawOut(_BufferOut, Section.Section);
+  }
+  for (const DNAIndexedSection &Section : Sections) {
+    _BufferOut.resize(Base + Section.Section.offset, 0);
+    _BufferOut.insert(_BufferOut.end(), Section.Data.begin(),
+                      Section.Data.end());
+  }
+  _BufferOut.resize(Base + Offset, 0);
+}
+
+/** Reads back what the Write*Out functions wrote, every read fails once the
+ * end of the buffer is reached. */
+typedef struct DNAReader {
+  const unsigned char *itr;
+  const unsigned char *end;
+} DNAReader;
+
+static bool ReadWordIn(DNAReader *Reader, const char *Word) {
+  size_t len = strlen(Word);
+  if ((size_t)(Reader->end - Reader->itr) < len ||
+      memcmp(Reader->itr, Word, len) != 0) {
+    return false;
+  }
+  Reader->itr += len;
+  return true;
+}
+
+/** Whether the DNA of \a Reader is read, at the end of the buffer or at the
+ * "TRGT" section of DNA_write_targets(), whose other targets are not read. */
+static bool AtEndIn(const DNAReader *Reader) {
+  return Reader->itr == Reader->end ||
+         ((size_t)(Reader->end - Reader->itr) >= 4 &&
+          memcmp(Reader->itr, "TRGT", 4) == 0);
+}
+
+static bool ReadStringIn(DNAReader *Reader, std::string &Word) {
+  const unsigned char *term =
+      (const unsigned char *)memchr(Reader->itr, '\0', Reader->end - Reader->itr);
+  if (!term) {
+    return false;
+  }
+  Word.assign((const char *)Reader->itr, term - Reader->itr);
+  Reader->itr = term + 1;
+  return true;
+}
+
+static bool ReadIntIn(DNAReader *Reader, int *value) {
+  if ((size_t)(Reader->end - Reader->itr) < sizeof(*value)) {
+    return false;
+  }
+  memcpy(value, Reader->itr, sizeof(*value));
+  Reader->itr += sizeof(*value);
+  return true;
+}
+
+/** Read a struct written by DNA_write_struct() at the end of \a DNA. */
+static bool ReadStructIn(DNAReader *Reader, SDNA *DNA, std::string &Name,
+                         std::string &Type) {
+  int FieldsLen;
+  if (!ReadStringIn(Reader, Name)) {
+    return false;
+  }
+  DNAStruct *Struct = DNA_add_struct(DNA, Name);
+  if (!Struct || !ReadIntIn(Reader, &Struct->size) ||
+      !ReadIntIn(Reader, &FieldsLen)) {
+    return false;
+  }
+  for (int FieldIndex = 0; FieldIndex < FieldsLen; FieldIndex++) {
+    if (!ReadStringIn(Reader, Name) || !ReadStringIn(Reader, Type)) {
+      return false;
+    }
+    DNAField *Field = DNA_add_field(DNA, Struct, Name);
+    if (!Field) {
+      return false;
+    }
+    Field->type = DNA_intern(DNA, Type.c_str(), Type.size());
+    if (Field->type < 0 || !ReadIntIn(Reader, &Field->offset) ||
+        !ReadIntIn(Reader, &Field->size) ||
+        !ReadIntIn(Reader, &Field->align) ||
+        !ReadIntIn(Reader, &Field->array) ||
+        !ReadIntIn(Reader, &Field->flags)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/** Skip a struct written by DNA_write_struct(), \a FieldsLen is its number of
+ * fields. */
+static bool SkipStructIn(DNAReader *Reader, int *FieldsLen) {
+  std::string Word;
+  int Value;
+  if (!ReadStringIn(Reader, Word) || !ReadIntIn(Reader, &Value) ||
+      !ReadIntIn(Reader, FieldsLen) || *FieldsLen < 0) {
+    return false;
+  }
+  for (int FieldIndex = 0; FieldIndex < *FieldsLen; FieldIndex++) {
+    if (!ReadStringIn(Reader, Word) || !ReadStringIn(Reader, Word)) {
+      return false;
+    }
+    for (int Int = 0; Int < 5; Int++) {
+      if (!ReadIntIn(Reader, &Value)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/** Read the "TYPE" section of DNA_write(), the type of each field is an index
+ * in \a Types or -1. */
+static bool ReadTypesIn(DNAReader *Reader, std::vector<DNAType> &Types,
+                        std::vector<std::string> &Names,
+                        std::vector<int> &FieldTypes) {
+  int TypesLen, FieldsLen;
+  /** A type takes at least its terminator and three integers, a count the
+   * buffer can not hold is not allocated. */
+  if (!ReadWordIn(Reader, "TYPE") || !ReadIntIn(Reader, &TypesLen) ||
+      TypesLen < 0 ||
+      (size_t)(Reader->end - Reader->itr) / (1 + 3 * sizeof(int)) <
+          (size_t)TypesLen) {
+    return false;
+  }
+  Types.resize(TypesLen);
+  Names.resize(TypesLen);
+  for (int Id = 0; Id < TypesLen; Id++) {
+    DNAType *Type = &Types[Id];
+    Type->name = 0;
+    if (!ReadStringIn(Reader, Names[Id]) || !ReadIntIn(Reader, &Type->kind) ||
+        !ReadIntIn(Reader, &Type->size) || !ReadIntIn(Reader, &Type->index) ||
+        Type->kind < DNA_TYPE_PRIMITIVE || Type->kind > DNA_TYPE_OPAQUE) {
+      return false;
+    }
+    if (Type->kind == DNA_TYPE_PRIMITIVE &&
+        (Type->index < 0 || Type->index >= DNA_PRIMITIVE_COUNT)) {
+      return false;
+    }
+  }
+  if (!ReadIntIn(Reader, &FieldsLen) || FieldsLen < 0 ||
+      (size_t)(Reader->end - Reader->itr) < (size_t)FieldsLen * sizeof(int)) {
+    return false;
+  }
+  FieldTypes.resize(FieldsLen);
+  for (int &Id : FieldTypes) {
+    if (!ReadIntIn(Reader, &Id) || Id < -1 || Id >= TypesLen) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/** The tables of one target of an indexed DNA. The sections are checked to
+ * be in the buffer, the entries are checked as they are read. */
+struct DNAIndexedView {
+  const char *Strings;
+  uint64_t StringsLen;
+  const unsigned char *Structs, *Fields, *Types;
+  uint32_t StructsLen, FieldsLen, TypesLen;
+  uint32_t StructStride, FieldStride, TypeStride;
+};
+
+static bool DNA_is_indexed(const unsigned char *Buffer, size_t Size) {
+  return Size >= 4 && memcmp(Buffer, DNA_FORMAT_MAGIC, 4) == 0;
+}
+
+/** Find the tables of \a Target in \a Buffer, the buffer does not need to be
+ * aligned. */
+static bool DNA_view_indexed(const unsigned char *Buffer, size_t Size,
+                             uint32_t Target, DNAIndexedView *View) {
+  DNAFileHeader Header;
+  if (Size < sizeof(Header)) {
+    return false;
+  }
+  memcpy(&Header, Buffer, sizeof(Header));
+  if (memcmp(Header.magic, DNA_FORMAT_MAGIC, sizeof(Header.magic)) != 0 ||
+      Header.version != DNA_FORMAT_VERSION ||
+      Header.byte_order != DNA_FORMAT_BYTE_ORDER ||
+      Header.file_size != Size || Target >= Header.targets_len ||
+      Header.sections_offset > Size ||
+      (Size - Header.sections_offset) / sizeof(DNAFileSection) <
+          Header.sections_len) {
+    return false;
+  }
+
+  memset(View, 0, sizeof(DNAIndexedView));
+  for (uint32_t Index = 0; Index < Header.sections_len; Index++) {
+    DNAFileSection Section;
+    memcpy(&Section,
+           Buffer + Header.sections_offset + Index * sizeof(DNAFileSection),
+           sizeof(Section));
+    if (Section.offset > Size || Section.size > Size - Section.offset ||
+        (uint64_t)Section.count * Section.stride > Section.size) {
+      return false;
+    }
+    if (Section.target != Target) {
+      continue;
+    }
+    const unsigned char *Data = Buffer + Section.offset;
+    switch (Section.kind) {
+    case DNA_SECTION_STRINGS:
+      /** Every offset in the strings is then terminated. */
+      if (Section.size == 0 || Data[Section.size - 1] != '\0') {
+        return false;
+      }
+      View->Strings = (const char *)Data;
+      View->StringsLen = Section.size;
+      break;
+    case DNA_SECTION_STRUCTS:
+      if (Section.stride < sizeof(DNAFileStruct)) {
+        return false;
+      }
+      View->Structs = Data;
+      View->StructsLen = Section.count;
+      View->StructStride = Section.stride;
+      break;
+    case DNA_SECTION_FIELDS:
+      if (Section.stride < sizeof(DNAFileField)) {
+        return false;
+      }
+      View->Fields = Data;
+      View->FieldsLen = Section.count;
+      View->FieldStride = Section.stride;
+      break;
+    case DNA_SECTION_TYPES:
+      if (Section.stride < sizeof(DNAFileType)) {
+        return false;
+      }
+      View->Types = Data;
+      View->TypesLen = Section.count;
+      View->TypeStride = Section.stride;
+      break;
+    default:
+      /** Sections of later versions. */
+      break;
+    }
+  }
+  return View->Strings != NULL;
+}
+
+static const char *DNA_indexed_string(const DNAIndexedView *View,
+                                      uint32_t Offset) {
+  return Offset < View->StringsLen ? View->Strings + Offset : NULL;
+}
+
+/** Append the struct \a StructIndex of \a View to \a DNA, the fields with
+ * their types. */
+static bool ReadIndexedStructIn(const DNAIndexedView *View,
+                                uint32_t StructIndex, SDNA *DNA) {
+  DNAFileStruct FileStruct;
+  memcpy(&FileStruct, View->Structs + (size_t)StructIndex * View->StructStride,
+         sizeof(FileStruct));
+  const char *Name = DNA_indexed_string(View, FileStruct.name);
+  if (!Name || FileStruct.fields_index > View->FieldsLen ||
+      FileStruct.fields_len > View->FieldsLen - FileStruct.fields_index) {
+    return false;
+  }
+  DNAStruct *Struct = DNA_add_struct(DNA, Name);
+  if (!Struct) {
+    return false;
+  }
+  Struct->size = FileStruct.size;
+
+  for (uint32_t FieldIndex = FileStruct.fields_index;
+       FieldIndex != FileStruct.fields_index + FileStruct.fields_len;
+       FieldIndex++) {
+    DNAFileField FileField;
+    memcpy(&FileField, View->Fields + (size_t)FieldIndex * View->FieldStride,
+           sizeof(FileField));
+    const char *FieldName = DNA_indexed_string(View, FileField.name);
+    const char *Type = DNA_indexed_string(View, FileField.type);
+    if (!FieldName || !Type) {
+      return false;
+    }
+    DNAField *Field = DNA_add_field(DNA, Struct, FieldName);
+    if (!Field) {
+      return false;
+    }
+    Field->type = DNA_intern(DNA, Type, strlen(Type));
+    Field->offset = FileField.offset;
+    Field->size = FileField.size;
+    Field->align = FileField.align;
+    Field->array = FileField.array;
+    Field->flags = FileField.flags;
+    if (Field->type < 0) {
+      return false;
+    }
+
+    if (FileField.type_id < 0) {
+      continue;
+    }
+    DNAFileType FileType;
+    if ((uint32_t)FileField.type_id >= View->TypesLen) {
+      return false;
+    }
+    memcpy(&FileType,
+           View->Types + (size_t)FileField.type_id * View->TypeStride,
+           sizeof(FileType));
+    const char *TypeName = DNA_indexed_string(View, FileType.name);
+    if (!TypeName || FileType.kind > DNA_TYPE_OPAQUE ||
+        (FileType.kind == DNA_TYPE_PRIMITIVE &&
+         (FileType.index < 0 || FileType.index >= DNA_PRIMITIVE_COUNT))) {
+      return false;
+    }
+    Field->type_id = DNA_add_type(DNA, (int)FileType.kind, TypeName,
+                                  FileType.size, FileType.index);
+    if (Field->type_id < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DNA_read(SDNA *DNA, const unsigned char *Buffer, size_t Size) {
+  if (DNA_is_indexed(Buffer, Size)) {
+    DNAIndexedView View;
+    if (!DNA_view_indexed(Buffer, Size, 0, &View)) {
+      return false;
+    }
+    for (uint32_t StructIndex = 0; StructIndex < View.StructsLen;
+         StructIndex++) {
+      if (!ReadIndexedStructIn(&View, StructIndex, DNA)) {
+        return false;
+      }
+    }
+    DNA_resolve_types(DNA);
+    return true;
+  }
+
+  DNAReader Reader = {Buffer, Buffer + Size};
+
+  int StructsLen;
+  if (!ReadWordIn(&Reader, "SDNA") || !ReadIntIn(&Reader, &StructsLen)) {
+    return false;
+  }
+
+  int FieldsBase = DNA->_FieldsLen;
+  std::string Name, Type;
+  for (int StructIndex = 0; StructIndex < StructsLen; StructIndex++) {
+    if (!ReadStructIn(&Reader, DNA, Name, Type)) {
+      return false;
+    }
+  }
+
+  if (!AtEndIn(&Reader)) {
+    std::vector<DNAType> Types;
+    std::vector<std::string> Names;
+    std::vector<int> FieldTypes;
+    if (!ReadTypesIn(&Reader, Types, Names, FieldTypes) ||
+        FieldTypes.size() != (size_t)(DNA->_FieldsLen - FieldsBase)) {
+      return false;
+    }
+    std::vector<int> Ids(Types.size());
+    for (size_t Id = 0; Id < Types.size(); Id++) {
+      Ids[Id] = DNA_add_type(DNA, Types[Id].kind, Names[Id], Types[Id].size,
+                             Types[Id].index);
+      if (Ids[Id] < 0) {
+        return false;
+      }
+    }
+    for (size_t FieldIndex = 0; FieldIndex < FieldTypes.size(); FieldIndex++) {
+      int Id = FieldTypes[FieldIndex];
+      DNA->_Fields[FieldsBase + FieldIndex].type_id = Id < 0 ? -1 : Ids[Id];
+    }
+  }
+  DNA_resolve_types(DNA);
+  return AtEndIn(&Reader);
+}
+
+void DNA_sort(SDNA *DNA) {
+  std::stable_sort(DNA->_Types, DNA->_Types + DNA->_TypesLen,
+                   [DNA](const DNAStruct &A, const DNAStruct &B) {
+                     return strcmp(DNA_string(DNA, A.name),
+                                   DNA_string(DNA, B.name)) < 0;
+                   });
+  DNA_resolve_types(DNA);
+}
+
+DNAStream::DNAStream(const unsigned char *Buffer, size_t Size)
+    : Begin(Buffer), Itr(Buffer), End(Buffer + Size), Count(0), Index(0),
+      Failed(false), FieldIndex(0), StructsEnd(Buffer + Size) {}
+
+bool DNAStream::begin() {
+  Index = 0;
+  if (DNA_is_indexed(Begin, End - Begin)) {
+    auto View = std::make_shared<DNAIndexedView>();
+    if (!DNA_view_indexed(Begin, End - Begin, 0, View.get()) ||
+        View->StructsLen > (uint32_t)INT32_MAX) {
+      Failed = true;
+      return false;
+    }
+    Count = (int)View->StructsLen;
+    Indexed = std::move(View);
+    return true;
+  }
+
+  DNAReader Reader = {Begin, End};
+  if (!ReadWordIn(&Reader, "SDNA") || !ReadIntIn(&Reader, &Count) ||
+      Count < 0) {
+    Failed = true;
+    return false;
+  }
+  Itr = Reader.itr;
+  FieldIndex = 0;
+
+  /** The types follow the structs, skim over them to find the types. */
+  size_t FieldsLen = 0;
+  for (int StructIndex = 0; StructIndex < Count; StructIndex++) {
+    int StructFieldsLen;
+    if (!SkipStructIn(&Reader, &StructFieldsLen)) {
+      Failed = true;
+      return false;
+    }
+    FieldsLen += StructFieldsLen;
+  }
+  StructsEnd = Reader.itr;
+  Types.clear();
+  TypeNames.clear();
+  FieldTypes.clear();
+  if (!AtEndIn(&Reader) &&
+      (!ReadTypesIn(&Reader, Types, TypeNames, FieldTypes) ||
+       FieldTypes.size() != FieldsLen || !AtEndIn(&Reader))) {
+    Failed = true;
+    return false;
+  }
+  return true;
+}
+
+bool DNAStream::next(SDNA *Struct) {
+  DNA_clear(Struct);
+  if (Failed) {
+    return false;
+  }
+  if (Index == Count) {
+    /** Trailing bytes are not part of a DNA. */
+    Failed = !Indexed && Itr != StructsEnd;
+    return false;
+  }
+  if (Indexed) {
+    if (!ReadIndexedStructIn(Indexed.get(), Index, Struct)) {
+      DNA_clear(Struct);
+      Failed = true;
+      return false;
+    }
+    DNA_resolve_types(Struct);
+    Index++;
+    return true;
+  }
+
+  DNAReader Reader = {Itr, StructsEnd};
+  std::string Name, Type;
+  if (!ReadStructIn(&Reader, Struct, Name, Type)) {
+    DNA_clear(Struct);
+    Failed = true;
+    return false;
+  }
+  for (DNAField *Field = Struct->_Fields;
+       !FieldTypes.empty() && Field != Struct->_Fields + Struct->_FieldsLen;
+       ++Field) {
+    int Id = FieldTypes[FieldIndex++];
+    if (Id < 0) {
+      continue;
+    }
+    Field->type_id = DNA_add_type(Struct, Types[Id].kind, TypeNames[Id],
+                                  Types[Id].size, Types[Id].index);
+    if (Field->type_id < 0) {
+      DNA_clear(Struct);
+      Failed = true;
+      return false;
+    }
+  }
+  DNA_resolve_types(Struct);
+  Itr = Reader.itr;
+  Index++;
+  return true;
+}
+
+bool DNAStream::sorted() const {
+  DNAStream Stream(Begin, End - Begin);
+  if (!Stream.begin()) {
+    return false;
+  }
+  SDNA Struct;
+  memset(&Struct, 0, sizeof(SDNA));
+  std::string Previous;
+  bool HasPrevious = false, Sorted = true;
+  while (Sorted && Stream.next(&Struct)) {
+    const char *Name = DNA_string(&Struct, Struct._Types[0].name);
+    Sorted = !HasPrevious || strcmp(Previous.c_str(), Name) <= 0;
+    Previous = Name;
+    HasPrevious = true;
+  }
+  DNA_free(&Struct);
+  return Sorted && !Stream.failed();
+}
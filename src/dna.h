@@ -0,0 +1,303 @@
+//===---- dna.h - In memory representation of rose DNA --------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_DNA_H
+#define ROSE_DNA_DNA_H
+
+#include "dna_format.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** The reason offset, size and array ar integers is because we want to have the
+ * same time in both x86 and x64. */
+
+typedef struct DNAField {
+  /** Names and types are strings of the SDNA, see DNA_string(). */
+  int name;
+  /** Use with caution this might not exist in SDNA. */
+  int type;
+  /** Index of the resolved \a type in #SDNA._TypeTable, -1 when unknown. */
+  int type_id;
+
+  int offset;
+  int size;
+  int align;
+  int array;
+
+  int flags;
+} DNAField;
+
+/** Canonical name of a DNA_PRIMITIVE_*, "int32" or "float64". */
+const char *DNA_primitive_name(int Primitive);
+/** The DNA_PRIMITIVE_* of an integer of \a Size bytes, -1 when there is
+ * none. */
+int DNA_primitive_integer(bool Signed, int Size);
+
+/** The type of fields once the spelling is gone, every field of an SDNA with
+ * the same type refers to the same DNAType. */
+typedef struct DNAType {
+  /** The struct name for records, DNA_primitive_name() for primitives. */
+  int name;
+  int kind;
+  /** In bytes, 0 when unknown. */
+  int size;
+  int index;
+} DNAType;
+
+typedef struct DNAStruct {
+  int name;
+
+  int size;
+
+  /** The fields of a struct are contiguous in #SDNA._Fields. */
+  int _FieldsIndex;
+  int _FieldsLen;
+} DNAStruct;
+
+/** The structs, their fields and their strings each live in a single array
+ * that grows geometrically, an SDNA is a handful of allocations no matter how
+ * many structs it holds. Every string is stored once, structs and fields
+ * refer to it by offset. A zeroed SDNA is empty. */
+typedef struct SDNA {
+  DNAStruct *_Types;
+  int _TypesLen;
+  int _TypesCap;
+
+  DNAField *_Fields;
+  int _FieldsLen;
+  int _FieldsCap;
+
+  /** Null terminated strings back to back, the empty string is at 0. */
+  char *_Strings;
+  int _StringsLen;
+  int _StringsCap;
+  /** Open addressing table of the offsets of the strings by hash, 0 is a free
+   * slot. */
+  int *_StringsIndex;
+  int _StringsIndexLen;
+  int _StringsIndexCap;
+
+  /** Each distinct type once, found by kind and name through an open
+   * addressing table of type indices plus one. */
+  DNAType *_TypeTable;
+  int _TypeTableLen;
+  int _TypeTableCap;
+  int *_TypeTableIndex;
+  int _TypeTableIndexCap;
+} SDNA;
+
+/** Offset of \a String in the strings of \a DNA, it is added the first time.
+ * Returns -1 when out of memory. */
+int DNA_intern(SDNA *DNA, const char *String, size_t Length);
+inline const char *DNA_string(const SDNA *DNA, int Offset) {
+  return DNA->_Strings ? DNA->_Strings + Offset : "";
+}
+
+/** The returned struct moves when another struct is added. */
+DNAStruct *DNA_add_struct(SDNA *DNA, const std::string &name);
+/** Fields can only be added to the last struct of \a DNA. The returned field
+ * moves when another field is added. */
+DNAField *DNA_add_field(SDNA *DNA, DNAStruct *Struct, const std::string &name);
+inline DNAField *DNA_struct_fields(const SDNA *DNA, const DNAStruct *Struct) {
+  return DNA->_Fields + Struct->_FieldsIndex;
+}
+/** Index in #SDNA._TypeTable of the type of \a kind named \a name, it is added
+ * the first time. For DNA_TYPE_PRIMITIVE \a name is ignored and \a index is
+ * the primitive, for DNA_TYPE_STRUCT \a index is left to
+ * DNA_resolve_types(). Returns -1 when out of memory. */
+int DNA_add_type(SDNA *DNA, int kind, const std::string &name, int size,
+                 int index);
+/** Point every DNA_TYPE_STRUCT type to the struct of the same name, needed
+ * again whenever structs are added or moved. DNA_sort() and DNA_read() do it
+ * on their own. */
+void DNA_resolve_types(SDNA *DNA);
+
+/** Append a copy of \a Struct of \a From, fields included, to \a DNA. */
+DNAStruct *DNA_copy_struct(SDNA *DNA, const SDNA *From,
+                           const DNAStruct *Struct);
+
+/** Hash of the layout of \a Struct, size and every field with its type,
+ * offset, size, alignment, array length and flags. It does not depend on the
+ * SDNA holding \a Struct. */
+uint64_t DNA_struct_fingerprint(const SDNA *DNA, const DNAStruct *Struct);
+
+/** Forget every struct and string of \a DNA but keep its memory. */
+void DNA_clear(SDNA *DNA);
+void DNA_free(SDNA *DNA);
+
+/** Does not include the null terminator */
+void WriteWordOut(std::vector<unsigned char> &Buffer, const std::string &Word);
+/** Does include the null terminator */
+void WriteStringOut(std::vector<unsigned char> &Buffer, const std::string &Word);
+void WriteIntOut(std::vector<unsigned char> &Buffer, int value);
+
+/** Serialize \a DNA at the end of \a _BufferOut. The structs are followed by
+ * a "TYPE" section with the number of types, each type (name, kind, size and
+ * index), the number of fields and the type index of each field in the order
+ * of the structs. */
+void DNA_write(const SDNA *DNA, std::vector<unsigned char> &_BufferOut);
+/** Serialize a single struct of \a DNA without the types of its fields,
+ * DNA_write() writes "SDNA" and the number of structs followed by each of
+ * them. */
+void DNA_write_struct(const SDNA *DNA, const DNAStruct *Struct,
+                      std::vector<unsigned char> &_BufferOut);
+
+/** Writes what DNA_write() does one struct at a time, so that a DNA can be
+ * written as it is built: only the names of the structs, the types and the
+ * type of each field are kept until finish(). The caller may write out and
+ * empty \a _BufferOut between the calls, it then writes the number of structs
+ * finish() returns at #CountOffset of the output. */
+class DNAStreamWriter {
+public:
+  DNAStreamWriter();
+  ~DNAStreamWriter();
+  DNAStreamWriter(const DNAStreamWriter &) = delete;
+  DNAStreamWriter &operator=(const DNAStreamWriter &) = delete;
+
+  /** "SDNA" and a number of structs of 0. */
+  void begin(std::vector<unsigned char> &_BufferOut);
+  /** Write \a Struct of \a DNA, returns false when out of memory. */
+  bool add(const SDNA *DNA, const DNAStruct *Struct,
+           std::vector<unsigned char> &_BufferOut);
+  /** Write the "TYPE" section, returns the number of structs. */
+  int finish(std::vector<unsigned char> &_BufferOut);
+
+  /** Where begin() writes the number of structs, in bytes. */
+  static const size_t CountOffset = 4;
+
+private:
+  /** The structs written so far, without their fields, and their types. */
+  SDNA Written;
+  std::vector<int> FieldTypes;
+};
+/** The DNA of one target triple. */
+typedef struct DNATarget {
+  std::string Triple;
+  SDNA DNA;
+} DNATarget;
+
+/** Serialize the DNA of several targets. The first one is written like
+ * DNA_write() does so that readers unaware of targets keep working, it is
+ * followed by a "TRGT" section with the number of targets, the triple of the
+ * first one, then the triple and the DNA of each other target. */
+void DNA_write_targets(const std::vector<DNATarget> &Targets,
+                       std::vector<unsigned char> &_BufferOut);
+
+/** How a DNA file is written. */
+enum class DNAFormat {
+  /** Indexed in place without parsing it, see dna_format.h. */
+  Indexed,
+  /** The "SDNA" stream of DNA_write() and DNA_write_targets(). */
+  Legacy,
+};
+
+/** Serialize the DNA of every target in the indexed format of dna_format.h,
+ * the offsets are from the start of the DNA. The triples may be empty. */
+void DNA_write_indexed(const std::vector<DNATarget> &Targets,
+                       std::vector<unsigned char> &_BufferOut);
+
+/** Append the structs serialized in \a Buffer to \a DNA, returns false when
+ * \a Buffer is not a valid DNA, \a DNA may then hold part of the structs. The
+ * fields of a DNA written before the "TYPE" section existed are not
+ * resolved. Both formats are read, only the first target of an indexed DNA
+ * or of DNA_write_targets() is. */
+bool DNA_read(SDNA *DNA, const unsigned char *Buffer, size_t Size);
+
+/** Sort the structs of \a DNA by name, byte wise, and resolve the types
+ * again. */
+void DNA_sort(SDNA *DNA);
+
+struct DNAIndexedView;
+
+/** Reads the structs of a serialized DNA one at a time instead of building
+ * the whole SDNA, an indexed DNA is read in place. Like DNA_read(), only the
+ * first target is read. */
+class DNAStream {
+public:
+  DNAStream(const unsigned char *Buffer, size_t Size);
+
+  /** Read the header and the types, returns false when the buffer is not a
+   * DNA. */
+  bool begin();
+  /** Read the next struct in \a Struct, the only struct of \a Struct once
+   * it is emptied with DNA_clear(), with the types of its fields. Returns
+   * false after the last struct or when the buffer is broken. */
+  bool next(SDNA *Struct);
+  /** Whether the buffer turned out not to be a valid DNA. */
+  bool failed() const { return Failed; }
+
+  /** Whether the structs are sorted by name like DNA_sort() does, reads the
+   * whole buffer on its own. */
+  bool sorted() const;
+
+private:
+  const unsigned char *Begin, *Itr, *End;
+  int Count, Index;
+  bool Failed;
+  /** The "TYPE" section, read by begin(), and the fields read so far. */
+  std::vector<DNAType> Types;
+  std::vector<std::string> TypeNames;
+  std::vector<int> FieldTypes;
+  size_t FieldIndex;
+  /** Where the structs end. */
+  const unsigned char *StructsEnd;
+  /** The tables of the first target of an indexed DNA. */
+  std::shared_ptr<const DNAIndexedView> Indexed;
+};
+
+/** File each struct of an SDNA is declared in, by struct name. */
+typedef std::unordered_map<std::string, std::string> DNASources;
+
+/** Two definitions of the same struct name with different layouts. */
+typedef struct DNAConflict {
+  std::string Name;
+  /** Where the definition that was kept comes from. */
+  std::string KeptOrigin;
+  /** Where the definition that was dropped comes from. */
+  std::string Origin;
+} DNAConflict;
+
+/** Appends the structs of shards to an SDNA, a struct is only kept the first
+ * time its name is seen. A later struct with the same name but a different
+ * fingerprint is recorded in \a Conflicts instead of being emitted twice.
+ * Merging shards in a fixed order gives the same SDNA no matter which thread
+ * filled each shard. */
+class DNAMerger {
+public:
+  /** \a DNA is expected to be empty. */
+  DNAMerger(SDNA *DNA);
+
+  /** \a Shard is left empty, \a Origin names it in the conflicts.
+   * \a ShardSources is the file each struct of \a Shard is declared in, in
+   * the order of the structs, when known. */
+  bool merge(SDNA *Shard, const std::string &Origin,
+             const std::vector<std::string> *ShardSources = NULL);
+
+  std::vector<DNAConflict> Conflicts;
+  /** Files of the structs that were kept. */
+  DNASources Sources;
+
+private:
+  struct Entry {
+    uint64_t Fingerprint;
+    /** Index in #Origins of the shard the struct comes from. */
+    int Origin;
+  };
+
+  SDNA *DNA;
+  std::unordered_map<std::string, Entry> Index;
+  std::vector<std::string> Origins;
+};
+
+#endif // ROSE_DNA_DNA_H
@@ -0,0 +1,179 @@
+//===---- dna_format.h - Indexed rose DNA file format ---------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  The version 2 of the DNA file, made to be mapped in memory and indexed in
+//  place instead of being parsed. The file is a DNAFileHeader, the directory
+//  of its sections (DNAFileSection[sections_len]) and the sections. Every
+//  section starts on 8 bytes and holds \a count entries of \a stride bytes, a
+//  reader only relies on the first sizeof() bytes of an entry so that later
+//  versions can grow them. Integers are in the byte order of the machine that
+//  wrote the file, see \a byte_order.
+//
+//  Each target has its own strings, structs, fields, types and names
+//  sections, \a target tells which. The strings are null terminated and
+//  referred to by offset, 0 is the empty string. The fields of a struct are
+//  contiguous. The names section is an open addressing table of the structs
+//  by DNA_format_hash() of their name. The field flags, the kinds of types
+//  and the primitives have the same values as in the SDNA.
+//
+//  Only depends on the C standard headers so that any consumer can include
+//  it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_DNA_FORMAT_H
+#define ROSE_DNA_DNA_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Not "SDNA" so that the readers of the version 1 stream reject it. */
+#define DNA_FORMAT_MAGIC "RDNA"
+#define DNA_FORMAT_VERSION 2
+/** Written as an integer, reads 0x04030201 on a machine of the other byte
+ * order. */
+#define DNA_FORMAT_BYTE_ORDER 0x01020304u
+#define DNA_FORMAT_ALIGN 8
+
+enum {
+  /** DNAFileTarget[targets_len], \a target is 0. */
+  DNA_SECTION_TARGETS = 1,
+  /** The strings, char[size]. */
+  DNA_SECTION_STRINGS = 2,
+  /** DNAFileStruct[count]. */
+  DNA_SECTION_STRUCTS = 3,
+  /** DNAFileField[count]. */
+  DNA_SECTION_FIELDS = 4,
+  /** DNAFileType[count]. */
+  DNA_SECTION_TYPES = 5,
+  /** uint32_t[count], a power of two, of struct indices plus one, 0 is a
+     free slot. */
+  DNA_SECTION_NAMES = 6,
+};
+
+enum {
+  /** This field is a pointer, if this is an array too the elements of the array
+     are pointers. */
+  DNA_FIELD_IS_POINTER = (1 << 0),
+  /** This field is an array, its array length is the number of elements. */
+  DNA_FIELD_IS_ARRAY = (1 << 1),
+  /** This field is a pointer to a function (since all structures are in C). */
+  DNA_FIELD_IS_FUNCTION = (1 << 2),
+};
+
+/** What a resolved type is. */
+enum {
+  /** A builtin type, the index of the type is one of the DNA_PRIMITIVE_*. */
+  DNA_TYPE_PRIMITIVE = 0,
+  /** A record, the index of the type is its struct or -1 when the DNA does
+     not hold it. */
+  DNA_TYPE_STRUCT = 1,
+  /** A function, what a function pointer points to. */
+  DNA_TYPE_FUNCTION = 2,
+  /** Anything else (vectors, complex numbers, pointers to arrays), only its
+     spelling is known. */
+  DNA_TYPE_OPAQUE = 3,
+};
+
+/** Builtin types by representation, the spelling does not matter: int,
+ * signed int and int32_t are all DNA_PRIMITIVE_INT32 on most targets, char is
+ * DNA_PRIMITIVE_INT8 or DNA_PRIMITIVE_UINT8 like the target has it and enums
+ * are their underlying integer. A pointer to a pointer points to
+ * DNA_PRIMITIVE_POINTER. */
+enum {
+  DNA_PRIMITIVE_VOID = 0,
+  DNA_PRIMITIVE_BOOL,
+  DNA_PRIMITIVE_INT8,
+  DNA_PRIMITIVE_UINT8,
+  DNA_PRIMITIVE_INT16,
+  DNA_PRIMITIVE_UINT16,
+  DNA_PRIMITIVE_INT32,
+  DNA_PRIMITIVE_UINT32,
+  DNA_PRIMITIVE_INT64,
+  DNA_PRIMITIVE_UINT64,
+  DNA_PRIMITIVE_INT128,
+  DNA_PRIMITIVE_UINT128,
+  DNA_PRIMITIVE_FLOAT16,
+  DNA_PRIMITIVE_FLOAT32,
+  DNA_PRIMITIVE_FLOAT64,
+  /** The x87 extended precision, stored in 10, 12 or 16 bytes. */
+  DNA_PRIMITIVE_FLOAT80,
+  DNA_PRIMITIVE_FLOAT128,
+  DNA_PRIMITIVE_POINTER,
+  DNA_PRIMITIVE_COUNT,
+};
+
+typedef struct DNAFileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t byte_order;
+  /** sizeof(DNAFileHeader) of the writer. */
+  uint32_t header_size;
+  uint64_t file_size;
+  uint64_t sections_offset;
+  uint32_t sections_len;
+  uint32_t targets_len;
+} DNAFileHeader;
+
+typedef struct DNAFileSection {
+  uint32_t kind;
+  uint32_t target;
+  uint64_t offset;
+  /** In bytes, the padding up to the next section excluded. */
+  uint64_t size;
+  uint32_t count;
+  uint32_t stride;
+} DNAFileSection;
+
+typedef struct DNAFileTarget {
+  /** In the strings of the target, empty when no triple was asked for. */
+  uint32_t triple;
+  uint32_t reserved;
+} DNAFileTarget;
+
+/** Names are offsets in the strings of the target. */
+typedef struct DNAFileStruct {
+  uint32_t name;
+  int32_t size;
+  /** The fields of the struct are fields_len entries from fields_index. */
+  uint32_t fields_index;
+  uint32_t fields_len;
+} DNAFileStruct;
+
+/** Same meaning as DNAField, \a offset is in bits. */
+typedef struct DNAFileField {
+  uint32_t name;
+  uint32_t type;
+  /** Index in the types section, -1 when unknown. */
+  int32_t type_id;
+  int32_t offset;
+  int32_t size;
+  int32_t align;
+  int32_t array;
+  uint32_t flags;
+} DNAFileField;
+
+/** Same meaning as DNAType, \a index of a record is its struct or -1. */
+typedef struct DNAFileType {
+  uint32_t name;
+  uint32_t kind;
+  int32_t size;
+  int32_t index;
+} DNAFileType;
+
+/** FNV-1a of \a Length bytes of \a Name, the slot of a struct in the names
+ * section is this hash modulo the count, then the next slots. */
+static inline uint32_t DNA_format_hash(const char *Name, size_t Length) {
+  uint32_t Hash = 2166136261u;
+  for (size_t Index = 0; Index < Length; Index++) {
+    Hash = (Hash ^ (unsigned char)Name[Index]) * 16777619u;
+  }
+  return Hash;
+}
+
+#endif // ROSE_DNA_DNA_FORMAT_H
@@ -0,0 +1,307 @@
+//===---- dna_reader.c - Read an indexed rose DNA in place ----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "dna_reader.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool DNA_file_open_memory(DNAFile *File, const void *Data, size_t Size) {
+  memset(File, 0, sizeof(DNAFile));
+  if ((uintptr_t)Data % DNA_FORMAT_ALIGN != 0 ||
+      Size < sizeof(DNAFileHeader)) {
+    return false;
+  }
+
+  const DNAFileHeader *Header = (const DNAFileHeader *)Data;
+  if (memcmp(Header->magic, DNA_FORMAT_MAGIC, sizeof(Header->magic)) != 0 ||
+      Header->version != DNA_FORMAT_VERSION ||
+      Header->byte_order != DNA_FORMAT_BYTE_ORDER ||
+      Header->file_size != Size ||
+      Header->sections_offset % DNA_FORMAT_ALIGN != 0 ||
+      Header->sections_offset > Size ||
+      (Size - Header->sections_offset) / sizeof(DNAFileSection) <
+          Header->sections_len) {
+    return false;
+  }
+
+  const DNAFileSection *Sections =
+      (const DNAFileSection *)((const unsigned char *)Data +
+                               Header->sections_offset);
+  for (uint32_t Index = 0; Index < Header->sections_len; Index++) {
+    const DNAFileSection *Section = &Sections[Index];
+    if (Section->offset % DNA_FORMAT_ALIGN != 0 || Section->offset > Size ||
+        Section->size > Size - Section->offset ||
+        (uint64_t)Section->count * Section->stride > Section->size) {
+      return false;
+    }
+  }
+
+  File->data = (const unsigned char *)Data;
+  File->size = Size;
+  File->targets_len = Header->targets_len;
+  File->_Sections = Sections;
+  File->_SectionsLen = Header->sections_len;
+  return true;
+}
+
+bool DNA_file_open(DNAFile *File, const char *Path) {
+  memset(File, 0, sizeof(DNAFile));
+#if defined(_WIN32)
+  HANDLE Handle = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (Handle == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER Size;
+  HANDLE Mapping = NULL;
+  if (GetFileSizeEx(Handle, &Size) && Size.QuadPart > 0) {
+    Mapping = CreateFileMappingA(Handle, NULL, PAGE_READONLY, 0, 0, NULL);
+  }
+  CloseHandle(Handle);
+  if (!Mapping) {
+    return false;
+  }
+  void *Data = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(Mapping);
+  if (!Data) {
+    return false;
+  }
+  if (!DNA_file_open_memory(File, Data, (size_t)Size.QuadPart)) {
+    UnmapViewOfFile(Data);
+    return false;
+  }
+#else
+  int FD = open(Path, O_RDONLY);
+  if (FD < 0) {
+    return false;
+  }
+  struct stat Status;
+  void *Data = MAP_FAILED;
+  if (fstat(FD, &Status) == 0 && Status.st_size > 0) {
+    Data = mmap(NULL, (size_t)Status.st_size, PROT_READ, MAP_SHARED, FD, 0);
+  }
+  /** The mapping outlives the descriptor. */
+  close(FD);
+  if (Data == MAP_FAILED) {
+    return false;
+  }
+  if (!DNA_file_open_memory(File, Data, (size_t)Status.st_size)) {
+    munmap(Data, (size_t)Status.st_size);
+    return false;
+  }
+#endif
+  File->_Mapping = Data;
+  return true;
+}
+
+void DNA_file_close(DNAFile *File) {
+  if (File->_Mapping) {
+#if defined(_WIN32)
+    UnmapViewOfFile(File->_Mapping);
+#else
+    munmap(File->_Mapping, File->size);
+#endif
+  }
+  memset(File, 0, sizeof(DNAFile));
+}
+
+bool DNA_file_view(const DNAFile *File, uint32_t Target, DNAView *View) {
+  memset(View, 0, sizeof(DNAView));
+  if (Target >= File->targets_len) {
+    return false;
+  }
+
+  uint32_t Triple = 0;
+  for (uint32_t Index = 0; Index < File->_SectionsLen; Index++) {
+    const DNAFileSection *Section = &File->_Sections[Index];
+    const unsigned char *Data = File->data + Section->offset;
+    if (Section->kind == DNA_SECTION_TARGETS) {
+      if (Section->stride >= sizeof(DNAFileTarget) &&
+          Section->stride % sizeof(uint32_t) == 0 &&
+          Target < Section->count) {
+        Triple =
+            ((const DNAFileTarget *)(Data + (size_t)Target * Section->stride))
+                ->triple;
+      }
+      continue;
+    }
+    if (Section->target != Target) {
+      continue;
+    }
+    /** The entries are read in place, they must stay aligned. */
+    switch (Section->kind) {
+    case DNA_SECTION_STRINGS:
+      if (Section->size == 0 || Data[Section->size - 1] != '\0') {
+        return false;
+      }
+      View->_Strings = (const char *)Data;
+      View->_StringsLen = Section->size;
+      break;
+    case DNA_SECTION_STRUCTS:
+      if (Section->stride < sizeof(DNAFileStruct) ||
+          Section->stride % sizeof(uint32_t) != 0) {
+        return false;
+      }
+      View->_Structs = Data;
+      View->_StructsLen = Section->count;
+      View->_StructStride = Section->stride;
+      break;
+    case DNA_SECTION_FIELDS:
+      if (Section->stride < sizeof(DNAFileField) ||
+          Section->stride % sizeof(uint32_t) != 0) {
+        return false;
+      }
+      View->_Fields = Data;
+      View->_FieldsLen = Section->count;
+      View->_FieldStride = Section->stride;
+      break;
+    case DNA_SECTION_TYPES:
+      if (Section->stride < sizeof(DNAFileType) ||
+          Section->stride % sizeof(uint32_t) != 0) {
+        return false;
+      }
+      View->_Types = Data;
+      View->_TypesLen = Section->count;
+      View->_TypeStride = Section->stride;
+      break;
+    case DNA_SECTION_NAMES:
+      if (Section->stride != sizeof(uint32_t) || Section->count == 0 ||
+          (Section->count & (Section->count - 1)) != 0) {
+        return false;
+      }
+      View->_Names = (const uint32_t *)Data;
+      View->_NamesLen = Section->count;
+      break;
+    default:
+      /** Sections of later versions. */
+      break;
+    }
+  }
+  if (!View->_Strings) {
+    return false;
+  }
+  View->triple = DNA_view_string(View, Triple);
+  if (!View->triple) {
+    View->triple = "";
+  }
+  return true;
+}
+
+const char *DNA_view_string(const DNAView *View, uint32_t Offset) {
+  /** The strings end with a terminator, checked by DNA_file_view(). */
+  return Offset < View->_StringsLen ? View->_Strings + Offset : NULL;
+}
+
+uint32_t DNA_view_structs_len(const DNAView *View) {
+  return View->_StructsLen;
+}
+
+const DNAFileStruct *DNA_view_struct(const DNAView *View, uint32_t Index) {
+  if (Index >= View->_StructsLen) {
+    return NULL;
+  }
+  return (const DNAFileStruct *)(View->_Structs +
+                                 (size_t)Index * View->_StructStride);
+}
+
+static bool DNA_view_struct_is(const DNAView *View,
+                               const DNAFileStruct *Struct,
+                               const char *Name) {
+  const char *StructName = DNA_view_string(View, Struct->name);
+  return StructName && strcmp(StructName, Name) == 0;
+}
+
+const DNAFileStruct *DNA_view_find_struct(const DNAView *View,
+                                          const char *Name) {
+  if (!View->_Names) {
+    for (uint32_t Index = 0; Index < View->_StructsLen; Index++) {
+      const DNAFileStruct *Struct = DNA_view_struct(View, Index);
+      if (DNA_view_struct_is(View, Struct, Name)) {
+        return Struct;
+      }
+    }
+    return NULL;
+  }
+
+  uint32_t Mask = View->_NamesLen - 1;
+  uint32_t Slot = DNA_format_hash(Name, strlen(Name)) & Mask;
+  /** Every slot is visited at most once, even in a broken table. */
+  for (uint32_t Probe = 0; Probe < View->_NamesLen; Probe++) {
+    uint32_t Entry = View->_Names[Slot];
+    if (Entry == 0) {
+      return NULL;
+    }
+    const DNAFileStruct *Struct = DNA_view_struct(View, Entry - 1);
+    if (Struct && DNA_view_struct_is(View, Struct, Name)) {
+      return Struct;
+    }
+    Slot = (Slot + 1) & Mask;
+  }
+  return NULL;
+}
+
+uint32_t DNA_view_struct_index(const DNAView *View,
+                               const DNAFileStruct *Struct) {
+  return (uint32_t)(((const unsigned char *)Struct - View->_Structs) /
+                    View->_StructStride);
+}
+
+const DNAFileField *DNA_view_field(const DNAView *View,
+                                   const DNAFileStruct *Struct,
+                                   uint32_t Index) {
+  if (Index >= Struct->fields_len ||
+      Struct->fields_index > View->_FieldsLen ||
+      Struct->fields_len > View->_FieldsLen - Struct->fields_index) {
+    return NULL;
+  }
+  return (const DNAFileField *)(View->_Fields +
+                                ((size_t)Struct->fields_index + Index) *
+                                    View->_FieldStride);
+}
+
+const DNAFileField *DNA_view_find_field(const DNAView *View,
+                                        const DNAFileStruct *Struct,
+                                        const char *Name) {
+  for (uint32_t Index = 0; Index < Struct->fields_len; Index++) {
+    const DNAFileField *Field = DNA_view_field(View, Struct, Index);
+    if (!Field) {
+      return NULL;
+    }
+    const char *FieldName = DNA_view_string(View, Field->name);
+    if (FieldName && strcmp(FieldName, Name) == 0) {
+      return Field;
+    }
+  }
+  return NULL;
+}
+
+const DNAFileType *DNA_view_field_type(const DNAView *View,
+                                       const DNAFileField *Field) {
+  if (Field->type_id < 0 || (uint32_t)Field->type_id >= View->_TypesLen) {
+    return NULL;
+  }
+  return (const DNAFileType *)(View->_Types +
+                               (size_t)Field->type_id * View->_TypeStride);
+}
+
+const DNAFileStruct *DNA_view_type_struct(const DNAView *View,
+                                          const DNAFileType *Type) {
+  if (Type->kind != DNA_TYPE_STRUCT || Type->index < 0) {
+    return NULL;
+  }
+  return DNA_view_struct(View, (uint32_t)Type->index);
+}
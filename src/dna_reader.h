@@ -0,0 +1,113 @@
+//===---- dna_reader.h - Read an indexed rose DNA in place ----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  The reader of the DNA files written by rose-dna (see dna_format.h) for the
+//  programs that use the layouts. The file is mapped in memory and nothing is
+//  copied nor parsed: the structs, fields and types returned point into the
+//  mapping and stay valid until the file is closed. Opening only checks the
+//  header and the directory of the sections, the entries are checked as they
+//  are read, so the cost of opening does not grow with the DNA.
+//
+//  Only depends on the C standard library and on mmap (MapViewOfFile on
+//  Windows), it can be used from C and C++.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_DNA_READER_H
+#define ROSE_DNA_DNA_READER_H
+
+#include "dna_format.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** An open DNA file, a zeroed DNAFile is closed. */
+typedef struct DNAFile {
+  const unsigned char *data;
+  size_t size;
+  uint32_t targets_len;
+
+  const DNAFileSection *_Sections;
+  uint32_t _SectionsLen;
+  /** Set when the file was mapped by DNA_file_open(). */
+  void *_Mapping;
+} DNAFile;
+
+/** The tables of one target of a DNAFile. */
+typedef struct DNAView {
+  /** Empty when no target triple was asked for. */
+  const char *triple;
+
+  const char *_Strings;
+  uint64_t _StringsLen;
+  const unsigned char *_Structs;
+  uint32_t _StructsLen;
+  uint32_t _StructStride;
+  const unsigned char *_Fields;
+  uint32_t _FieldsLen;
+  uint32_t _FieldStride;
+  const unsigned char *_Types;
+  uint32_t _TypesLen;
+  uint32_t _TypeStride;
+  /** Power of two, 0 when the file has no names section. */
+  const uint32_t *_Names;
+  uint32_t _NamesLen;
+} DNAView;
+
+/** Map \a Path in memory, returns false when it can not be mapped or is not
+ * an indexed DNA of the byte order of the machine. */
+bool DNA_file_open(DNAFile *File, const char *Path);
+/** Read a DNA already in memory, \a Data must be 8-byte aligned and outlive
+ * \a File. */
+bool DNA_file_open_memory(DNAFile *File, const void *Data, size_t Size);
+void DNA_file_close(DNAFile *File);
+
+/** The tables of \a Target, the first target is the main DNA. */
+bool DNA_file_view(const DNAFile *File, uint32_t Target, DNAView *View);
+
+/** The string at \a Offset of the strings of \a View, NULL when out of
+ * bounds. */
+const char *DNA_view_string(const DNAView *View, uint32_t Offset);
+
+uint32_t DNA_view_structs_len(const DNAView *View);
+/** NULL when \a Index is out of bounds. */
+const DNAFileStruct *DNA_view_struct(const DNAView *View, uint32_t Index);
+/** The struct named \a Name, NULL when there is none. */
+const DNAFileStruct *DNA_view_find_struct(const DNAView *View,
+                                          const char *Name);
+/** Index of \a Struct in the structs of \a View, like DNAFileType.index. */
+uint32_t DNA_view_struct_index(const DNAView *View,
+                               const DNAFileStruct *Struct);
+
+/** The field \a Index of \a Struct, NULL when out of bounds or when the
+ * fields of \a Struct are not in the file. */
+const DNAFileField *DNA_view_field(const DNAView *View,
+                                   const DNAFileStruct *Struct,
+                                   uint32_t Index);
+const DNAFileField *DNA_view_find_field(const DNAView *View,
+                                        const DNAFileStruct *Struct,
+                                        const char *Name);
+
+/** The resolved type of \a Field, NULL when it is unknown. */
+const DNAFileType *DNA_view_field_type(const DNAView *View,
+                                       const DNAFileField *Field);
+/** The struct a DNA_TYPE_STRUCT type refers to, NULL when the DNA does not
+ * hold it. */
+const DNAFileStruct *DNA_view_type_struct(const DNAView *View,
+                                          const DNAFileType *Type);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // ROSE_DNA_DNA_READER_H
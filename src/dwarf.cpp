@@ -0,0 +1,635 @@
+//===---- dwarf.cpp - Rose DNA from the debug info of objects -------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "dwarf.h"
+#include "extract.h"
+#include "trace.h"
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/DebugInfo/DWARF/DWARFDie.h"
+#include "llvm/DebugInfo/DWARF/DWARFFormValue.h"
+#include "llvm/DebugInfo/DWARF/DWARFUnit.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+using namespace llvm;
+
+namespace {
+/** How the target aligns the builtin types, DWARF only records an alignment
+ * when the sources ask for one. */
+enum class ScalarAlign {
+  /** Every builtin type is aligned to its size. */
+  Natural,
+  /** i386 System V and Darwin, types of 8 and 12 bytes are aligned to 4. */
+  X86,
+  /** i386 Windows, only the 12 bytes long double of MinGW is aligned to 4. */
+  X86Windows,
+  /** The rules of the target are not known, alignments are left to 0. */
+  Unknown,
+};
+
+/** Turns the typedefs of records of a compile unit into DNA structs, the
+ * names are spelled like clang prints the types of the AST. */
+class UnitExtractor {
+public:
+  /** \a X87 is whether the long double of the target is the x87 extended
+   * precision, DWARF only gives its size. */
+  UnitExtractor(DWARFUnit &Unit, SDNA *DNA, const StringSet<> &Headers,
+                bool X87, ScalarAlign Rule)
+      : Unit(Unit), DNA(DNA), Headers(Headers), X87(X87), Rule(Rule) {
+    DWARFDie UnitDie = Unit.getUnitDIE(/*ExtractUnitDIEOnly=*/false);
+    uint64_t Language =
+        dwarf::toUnsigned(UnitDie.find(dwarf::DW_AT_language), 0);
+    /** C spells the tag keyword of the records, C++ their scope. */
+    IsC = Language == dwarf::DW_LANG_C89 || Language == dwarf::DW_LANG_C ||
+          Language == dwarf::DW_LANG_C99 || Language == dwarf::DW_LANG_C11;
+  }
+
+  /** Visit the top level of the compile unit, namespaces included. */
+  void visit(DWARFDie Die) {
+    for (DWARFDie Child : Die.children()) {
+      if (Child.getTag() == dwarf::DW_TAG_typedef) {
+        extract(Child);
+      } else if (Child.getTag() == dwarf::DW_TAG_namespace) {
+        visit(Child);
+      }
+    }
+  }
+
+  /** File each extracted struct is declared in, in the order of the
+   * structs. */
+  std::vector<std::string> Sources;
+
+private:
+  static bool isQualifier(dwarf::Tag Tag) {
+    return Tag == dwarf::DW_TAG_const_type ||
+           Tag == dwarf::DW_TAG_volatile_type ||
+           Tag == dwarf::DW_TAG_restrict_type ||
+           Tag == dwarf::DW_TAG_atomic_type;
+  }
+
+  static bool isRecord(dwarf::Tag Tag) {
+    return Tag == dwarf::DW_TAG_structure_type ||
+           Tag == dwarf::DW_TAG_union_type || Tag == dwarf::DW_TAG_class_type;
+  }
+
+  static DWARFDie type(DWARFDie Die) {
+    return Die.getAttributeValueAsReferencedDie(dwarf::DW_AT_type);
+  }
+
+  /** The canonical type of \a Die, without typedefs and qualifiers. */
+  static DWARFDie canonical(DWARFDie Die) {
+    while (Die.isValid() && (Die.getTag() == dwarf::DW_TAG_typedef ||
+                             isQualifier(Die.getTag()))) {
+      Die = type(Die);
+    }
+    return Die;
+  }
+
+  /** Scope of \a Die like clang prints it, "ns::Outer::". */
+  std::string scope(DWARFDie Die) const {
+    std::string Scope;
+    for (DWARFDie Parent = Die.getParent();
+         Parent.isValid() && Parent.getTag() != dwarf::DW_TAG_compile_unit;
+         Parent = Parent.getParent()) {
+      const char *Name = Parent.getName(DINameKind::ShortName);
+      Scope = std::string(Name ? Name : "(anonymous namespace)") + "::" + Scope;
+    }
+    return Scope;
+  }
+
+  std::string name(DWARFDie Die) const {
+    if (!Die.isValid()) {
+      return "void";
+    }
+
+    const char *Name = Die.getName(DINameKind::ShortName);
+    switch (Die.getTag()) {
+    case dwarf::DW_TAG_base_type:
+      return Name ? Name : "";
+    case dwarf::DW_TAG_typedef:
+      return scope(Die) + (Name ? Name : "");
+    case dwarf::DW_TAG_structure_type:
+    case dwarf::DW_TAG_class_type:
+    case dwarf::DW_TAG_union_type:
+    case dwarf::DW_TAG_enumeration_type: {
+      const char *Keyword = Die.getTag() == dwarf::DW_TAG_union_type ? "union"
+                            : Die.getTag() == dwarf::DW_TAG_enumeration_type
+                                ? "enum"
+                            : Die.getTag() == dwarf::DW_TAG_class_type
+                                ? "class"
+                                : "struct";
+      if (!Name) {
+        return std::string(Keyword) + " (anonymous)";
+      }
+      if (IsC) {
+        return std::string(Keyword) + " " + Name;
+      }
+      return scope(Die) + Name;
+    }
+    case dwarf::DW_TAG_const_type:
+    case dwarf::DW_TAG_volatile_type:
+    case dwarf::DW_TAG_restrict_type: {
+      const char *Qualifier = Die.getTag() == dwarf::DW_TAG_const_type ? "const"
+                              : Die.getTag() == dwarf::DW_TAG_volatile_type
+                                  ? "volatile"
+                                  : "restrict";
+      DWARFDie Inner = type(Die);
+      if (Inner.isValid() && Inner.getTag() == dwarf::DW_TAG_pointer_type) {
+        return name(Inner) + Qualifier;
+      }
+      return std::string(Qualifier) + " " + name(Inner);
+    }
+    case dwarf::DW_TAG_atomic_type:
+      return "_Atomic(" + name(type(Die)) + ")";
+    case dwarf::DW_TAG_pointer_type:
+    case dwarf::DW_TAG_reference_type:
+    case dwarf::DW_TAG_rvalue_reference_type: {
+      const char *Declarator = Die.getTag() == dwarf::DW_TAG_pointer_type ? "*"
+                               : Die.getTag() == dwarf::DW_TAG_reference_type
+                                   ? "&"
+                                   : "&&";
+      DWARFDie Pointee = type(Die);
+      if (Pointee.isValid() &&
+          Pointee.getTag() == dwarf::DW_TAG_subroutine_type) {
+        return name(type(Pointee)) + " (" + Declarator + ")" +
+               parameters(Pointee);
+      }
+      std::string Inner = name(Pointee);
+      bool Nested = !Inner.empty() && Inner.back() == '*';
+      return Inner + (Nested ? "" : " ") + Declarator;
+    }
+    case dwarf::DW_TAG_array_type: {
+      std::string Result = name(type(Die)) + " ";
+      for (DWARFDie Child : Die.children()) {
+        if (Child.getTag() == dwarf::DW_TAG_subrange_type) {
+          Result += "[" + std::to_string(count(Child)) + "]";
+        }
+      }
+      return Result;
+    }
+    case dwarf::DW_TAG_subroutine_type:
+      return name(type(Die)) + " " + parameters(Die);
+    default:
+      return Name ? Name : "";
+    }
+  }
+
+  std::string parameters(DWARFDie Die) const {
+    std::string Result = "(";
+    bool First = true;
+    for (DWARFDie Child : Die.children()) {
+      if (Child.getTag() == dwarf::DW_TAG_formal_parameter) {
+        Result += (First ? "" : ", ") + name(type(Child));
+        First = false;
+      } else if (Child.getTag() == dwarf::DW_TAG_unspecified_parameters) {
+        Result += First ? "..." : ", ...";
+        First = false;
+      }
+    }
+    if (First && IsC && Die.find(dwarf::DW_AT_prototyped)) {
+      Result += "void";
+    }
+    return Result + ")";
+  }
+
+  static uint64_t count(DWARFDie Subrange) {
+    if (auto Count = dwarf::toUnsigned(Subrange.find(dwarf::DW_AT_count))) {
+      return *Count;
+    }
+    if (auto Upper = dwarf::toUnsigned(Subrange.find(dwarf::DW_AT_upper_bound))) {
+      uint64_t Lower =
+          dwarf::toUnsigned(Subrange.find(dwarf::DW_AT_lower_bound), 0);
+      return *Upper + 1 - Lower;
+    }
+    /** Flexible array member. */
+    return 0;
+  }
+
+  uint64_t size(DWARFDie Die) const {
+    Die = canonical(Die);
+    if (!Die.isValid()) {
+      return 0;
+    }
+    if (auto Size = dwarf::toUnsigned(Die.find(dwarf::DW_AT_byte_size))) {
+      return *Size;
+    }
+    switch (Die.getTag()) {
+    case dwarf::DW_TAG_pointer_type:
+    case dwarf::DW_TAG_reference_type:
+    case dwarf::DW_TAG_rvalue_reference_type:
+      return Unit.getAddressByteSize();
+    case dwarf::DW_TAG_array_type: {
+      uint64_t Size = size(type(Die));
+      for (DWARFDie Child : Die.children()) {
+        if (Child.getTag() == dwarf::DW_TAG_subrange_type) {
+          Size *= count(Child);
+        }
+      }
+      return Size;
+    }
+    default:
+      return 0;
+    }
+  }
+
+  /** ABI alignment of a builtin type of \a Size bytes, 0 when unknown. */
+  uint64_t scalarAlign(uint64_t Size) const {
+    switch (Rule) {
+    case ScalarAlign::Natural:
+      break;
+    case ScalarAlign::X86:
+      if (Size == 8 || Size == 12) {
+        return 4;
+      }
+      break;
+    case ScalarAlign::X86Windows:
+      if (Size == 12) {
+        return 4;
+      }
+      break;
+    case ScalarAlign::Unknown:
+      return 0;
+    }
+    return Size ? Size : 1;
+  }
+
+  /** DWARF only records the alignment when it was requested, otherwise it is
+   * the ABI alignment of the type like clang computes it, 0 when the rules of
+   * the target are not known. */
+  uint64_t align(DWARFDie Die) const {
+    for (DWARFDie Itr = Die; Itr.isValid(); Itr = type(Itr)) {
+      if (auto Align = dwarf::toUnsigned(Itr.find(dwarf::DW_AT_alignment))) {
+        return *Align;
+      }
+      if (Itr.getTag() != dwarf::DW_TAG_typedef &&
+          !isQualifier(Itr.getTag())) {
+        break;
+      }
+    }
+
+    Die = canonical(Die);
+    if (!Die.isValid()) {
+      return 1;
+    }
+    if (isRecord(Die.getTag())) {
+      uint64_t Align = 1;
+      for (DWARFDie Child : Die.children()) {
+        if ((Child.getTag() == dwarf::DW_TAG_member &&
+             !Child.find(dwarf::DW_AT_declaration)) ||
+            Child.getTag() == dwarf::DW_TAG_inheritance) {
+          uint64_t ChildAlign = align(type(Child));
+          if (ChildAlign == 0) {
+            return 0;
+          }
+          Align = std::max(Align, ChildAlign);
+        }
+      }
+      return Align;
+    }
+    if (Die.getTag() == dwarf::DW_TAG_array_type) {
+      return align(type(Die));
+    }
+    /** A complex number is aligned like its parts. */
+    if (Die.getTag() == dwarf::DW_TAG_base_type &&
+        dwarf::toUnsigned(Die.find(dwarf::DW_AT_encoding), 0) ==
+            dwarf::DW_ATE_complex_float) {
+      return scalarAlign(size(Die) / 2);
+    }
+    return scalarAlign(size(Die));
+  }
+
+  /** Offset in bits, like ASTContext::getFieldOffset(). */
+  static uint64_t offset(DWARFDie Member, uint64_t Size) {
+    if (auto Bits = dwarf::toUnsigned(Member.find(dwarf::DW_AT_data_bit_offset))) {
+      return *Bits;
+    }
+    uint64_t Bytes =
+        dwarf::toUnsigned(Member.find(dwarf::DW_AT_data_member_location), 0);
+    uint64_t Offset = Bytes * 8;
+    /** DWARF 2 and 3 bit fields count from the most significant bit of their
+     * storage unit. */
+    auto BitOffset = dwarf::toUnsigned(Member.find(dwarf::DW_AT_bit_offset));
+    auto BitSize = dwarf::toUnsigned(Member.find(dwarf::DW_AT_bit_size));
+    if (BitOffset && BitSize) {
+      uint64_t Storage =
+          dwarf::toUnsigned(Member.find(dwarf::DW_AT_byte_size), Size) * 8;
+      Offset += Storage - *BitOffset - *BitSize;
+    }
+    return Offset;
+  }
+
+  void extract(DWARFDie Typedef) {
+    DWARFDie Underlying = type(Typedef);
+    DWARFDie Record = canonical(Underlying);
+    if (!Record.isValid() || !isRecord(Record.getTag()) ||
+        Record.find(dwarf::DW_AT_declaration)) {
+      return;
+    }
+
+    SmallString<256> Path(Typedef.getDeclFile(
+        DILineInfoSpecifier::FileLineInfoKind::AbsoluteFilePath));
+    sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+    std::string File(Path.str());
+    if (!Headers.empty() && !Headers.count(File)) {
+      return;
+    }
+
+    if (!Records.insert(Record.getOffset()).second) {
+      /** Another typedef of the same record. */
+      return;
+    }
+
+    /** Named like its record whichever typedef names it, as the fields of
+     * its type are, clang names an anonymous record after its typedef. */
+    std::string StructName = Record.getName(DINameKind::ShortName)
+                                 ? name(Record)
+                                 : name(Typedef);
+    DNAStruct *Struct = DNA_add_struct(DNA, StructName);
+    if (!Struct) {
+      return;
+    }
+    Struct->size = size(Record);
+    Sources.push_back(File);
+
+    for (DWARFDie Member : Record.children()) {
+      if (Member.getTag() != dwarf::DW_TAG_member ||
+          Member.find(dwarf::DW_AT_declaration) ||
+          Member.find(dwarf::DW_AT_external)) {
+        /** Bases, nested types, methods and static members. */
+        continue;
+      }
+      const char *MemberName = Member.getName(DINameKind::ShortName);
+      DNAField *Field =
+          DNA_add_field(DNA, Struct, MemberName ? MemberName : "");
+      if (!Field) {
+        return;
+      }
+
+      DWARFDie FieldType = type(Member);
+      uint64_t FieldSize = size(FieldType);
+      Field->size = FieldSize;
+      Field->align = align(FieldType);
+      Field->offset = offset(Member, FieldSize);
+
+      /** Conventional so that single items can be multiplied. */
+      Field->array = 1;
+
+      DWARFDie TypeDie;
+      DWARFDie Canonical = canonical(FieldType);
+      dwarf::Tag Tag = Canonical.isValid() ? Canonical.getTag() : dwarf::Tag(0);
+      if (Tag == dwarf::DW_TAG_pointer_type) {
+        Field->flags |= DNA_FIELD_IS_POINTER;
+        DWARFDie Pointee = type(Canonical);
+        if (canonical(Pointee).isValid() &&
+            canonical(Pointee).getTag() == dwarf::DW_TAG_subroutine_type) {
+          Field->flags |= DNA_FIELD_IS_FUNCTION;
+        }
+        TypeDie = Pointee;
+      } else if (Tag == dwarf::DW_TAG_array_type) {
+        /** Find the simplest element type of arrays. */
+        DWARFDie Element = type(Canonical);
+        while (canonical(Element).isValid() &&
+               canonical(Element).getTag() == dwarf::DW_TAG_array_type) {
+          Element = type(canonical(Element));
+        }
+        uint64_t ElementSize = size(Element);
+        Field->array = ElementSize ? FieldSize / ElementSize : 0;
+
+        DWARFDie CanonicalElement = canonical(Element);
+        if (CanonicalElement.isValid() &&
+            CanonicalElement.getTag() == dwarf::DW_TAG_pointer_type) {
+          Field->flags |= DNA_FIELD_IS_POINTER;
+          TypeDie = type(CanonicalElement);
+        } else {
+          TypeDie = Element;
+        }
+      } else {
+        TypeDie = FieldType;
+      }
+      std::string TypeName = name(TypeDie);
+      Field->type = DNA_intern(DNA, TypeName.c_str(), TypeName.size());
+      Field->type_id = resolve(TypeDie);
+    }
+  }
+
+  /** Index of the type \a Die in the types of the DNA, like
+   * TypedefExtractor::resolve() does for clang types. */
+  int resolve(DWARFDie Die) {
+    /** An anonymous record is named after the last typedef of it. */
+    DWARFDie Typedef;
+    for (; Die.isValid() && (Die.getTag() == dwarf::DW_TAG_typedef ||
+                             isQualifier(Die.getTag()));
+         Die = type(Die)) {
+      if (Die.getTag() == dwarf::DW_TAG_typedef) {
+        Typedef = Die;
+      }
+    }
+    if (!Die.isValid()) {
+      return DNA_add_type(DNA, DNA_TYPE_PRIMITIVE, "", 0, DNA_PRIMITIVE_VOID);
+    }
+
+    int Size = (int)size(Die);
+    int Primitive = -1;
+    switch (Die.getTag()) {
+    case dwarf::DW_TAG_pointer_type:
+    case dwarf::DW_TAG_reference_type:
+    case dwarf::DW_TAG_rvalue_reference_type:
+    case dwarf::DW_TAG_ptr_to_member_type:
+      Primitive = DNA_PRIMITIVE_POINTER;
+      break;
+    case dwarf::DW_TAG_enumeration_type:
+      /** An enum is its underlying integer, signed when not told. */
+      if (type(Die).isValid()) {
+        return resolve(type(Die));
+      }
+      Primitive = DNA_primitive_integer(true, Size);
+      break;
+    case dwarf::DW_TAG_base_type:
+      switch (dwarf::toUnsigned(Die.find(dwarf::DW_AT_encoding), 0)) {
+      case dwarf::DW_ATE_boolean:
+        Primitive = DNA_PRIMITIVE_BOOL;
+        break;
+      case dwarf::DW_ATE_signed:
+      case dwarf::DW_ATE_signed_char:
+        Primitive = DNA_primitive_integer(true, Size);
+        break;
+      case dwarf::DW_ATE_unsigned:
+      case dwarf::DW_ATE_unsigned_char:
+      case dwarf::DW_ATE_UTF:
+        Primitive = DNA_primitive_integer(false, Size);
+        break;
+      case dwarf::DW_ATE_float:
+        if (Size == 2) {
+          Primitive = DNA_PRIMITIVE_FLOAT16;
+        } else if (Size == 4) {
+          Primitive = DNA_PRIMITIVE_FLOAT32;
+        } else if (Size == 8) {
+          Primitive = DNA_PRIMITIVE_FLOAT64;
+        } else if (X87 && name(Die) == "long double") {
+          Primitive = DNA_PRIMITIVE_FLOAT80;
+        } else if (Size == 16) {
+          Primitive = DNA_PRIMITIVE_FLOAT128;
+        }
+        break;
+      }
+      break;
+    case dwarf::DW_TAG_structure_type:
+    case dwarf::DW_TAG_class_type:
+    case dwarf::DW_TAG_union_type:
+      /** Spelled like extract() names the struct of the record. */
+      return DNA_add_type(DNA, DNA_TYPE_STRUCT,
+                          !Die.getName(DINameKind::ShortName) &&
+                                  Typedef.isValid()
+                              ? name(Typedef)
+                              : name(Die),
+                          Size, -1);
+    case dwarf::DW_TAG_subroutine_type:
+      return DNA_add_type(DNA, DNA_TYPE_FUNCTION, name(Die), 0, -1);
+    default:
+      break;
+    }
+    if (Primitive >= 0) {
+      return DNA_add_type(DNA, DNA_TYPE_PRIMITIVE, "", Size, Primitive);
+    }
+    return DNA_add_type(DNA, DNA_TYPE_OPAQUE, name(Die), Size, -1);
+  }
+
+  DWARFUnit &Unit;
+  SDNA *DNA;
+  const StringSet<> &Headers;
+  bool IsC;
+  bool X87;
+  ScalarAlign Rule;
+
+  DenseSet<uint64_t> Records;
+};
+} // end anonymous namespace
+
+/** The alignment rules of the builtin types of the target of \a Object, like
+ * the TargetInfo of clang has them. */
+static ScalarAlign TargetScalarAlign(const object::ObjectFile &Object) {
+  switch (Object.getArch()) {
+  case Triple::x86:
+    return Object.isCOFF() ? ScalarAlign::X86Windows : ScalarAlign::X86;
+  case Triple::x86_64:
+  case Triple::aarch64:
+  case Triple::aarch64_be:
+  case Triple::riscv32:
+  case Triple::riscv64:
+  case Triple::wasm32:
+  case Triple::wasm64:
+    return ScalarAlign::Natural;
+  case Triple::arm:
+  case Triple::armeb:
+  case Triple::thumb:
+  case Triple::thumbeb:
+    /** The APCS of Darwin aligns double and long long to 4, AAPCS does
+     * not. */
+    return Object.isMachO() ? ScalarAlign::Unknown : ScalarAlign::Natural;
+  case Triple::ppc64:
+  case Triple::ppc64le:
+    /** AIX aligns double to 4 inside records. */
+    return Object.isXCOFF() ? ScalarAlign::Unknown : ScalarAlign::Natural;
+  default:
+    return ScalarAlign::Unknown;
+  }
+}
+
+Error DWARFExtractor::extract(
+    const std::string &Object, std::vector<SDNA> &Shards,
+    std::vector<std::string> &Origins,
+    std::vector<std::vector<std::string>> &UnitSources) {
+  llvm::TimeTraceScope Scope("Read DWARF", Object);
+  auto Start = std::chrono::steady_clock::now();
+  auto Binary = object::ObjectFile::createObjectFile(Object);
+  if (!Binary) {
+    return Binary.takeError();
+  }
+
+  std::unique_ptr<DWARFContext> Context =
+      DWARFContext::create(*Binary->getBinary());
+  Triple::ArchType Arch = Binary->getBinary()->getArch();
+  bool X87 = Arch == Triple::x86 || Arch == Triple::x86_64;
+  ScalarAlign Rule = TargetScalarAlign(*Binary->getBinary());
+  DNAUnitStats ObjectStats;
+  ObjectStats.File = Object;
+  for (const auto &Unit : Context->compile_units()) {
+    SDNA Shard{NULL, 0};
+    UnitExtractor Extractor(*Unit, &Shard, Headers, X87, Rule);
+    DWARFDie UnitDie = Unit->getUnitDIE(/*ExtractUnitDIEOnly=*/false);
+    Extractor.visit(UnitDie);
+
+    const char *UnitName = UnitDie.getName(DINameKind::ShortName);
+    Shards.push_back(Shard);
+    Origins.push_back(Object + " (" + (UnitName ? UnitName : "?") + ")");
+    UnitSources.push_back(std::move(Extractor.Sources));
+
+    ObjectStats.Typedefs.Accepted += Shard._TypesLen;
+    for (const DNAStruct *Struct = Shard._Types;
+         Struct != Shard._Types + Shard._TypesLen; ++Struct) {
+      ObjectStats.Typedefs.Fields += Struct->_FieldsLen;
+    }
+  }
+
+  if (Stats) {
+    ObjectStats.Seconds = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - Start)
+                              .count();
+    Stats->recordUnit(ObjectStats);
+  }
+  return Error::success();
+}
+
+/** Like DNAExtractor::run() the objects are read by the worker threads and
+ * the shards are merged in the order of \a Objects. */
+bool DWARFExtractor::run(ArrayRef<std::string> Objects, SDNA *DNA) {
+  std::vector<std::vector<SDNA>> Shards(Objects.size());
+  std::vector<std::vector<std::string>> Origins(Objects.size());
+  std::vector<std::vector<std::vector<std::string>>> UnitSources(
+      Objects.size());
+  std::mutex ErrorMutex;
+  bool Success = true;
+
+  {
+    llvm::ThreadPool Pool(llvm::hardware_concurrency(Threads));
+    for (size_t Index = 0; Index < Objects.size(); Index++) {
+      Pool.async([&, Index]() {
+        TimeTraceTask Task;
+        if (Error E = extract(Objects[Index], Shards[Index], Origins[Index],
+                              UnitSources[Index])) {
+          std::lock_guard<std::mutex> Lock(ErrorMutex);
+          errs() << "Failed to read " << Objects[Index] << ": "
+                 << toString(std::move(E)) << "\n";
+          Success = false;
+        }
+      });
+    }
+    Pool.wait();
+  }
+
+  std::vector<DNAShard> Merged;
+  for (size_t Index = 0; Index < Objects.size(); Index++) {
+    for (size_t Unit = 0; Unit < Shards[Index].size(); Unit++) {
+      Merged.push_back({&Shards[Index][Unit], Origins[Index][Unit],
+                        &UnitSources[Index][Unit]});
+    }
+  }
+  return DNA_merge_shards(Merged, DNA, Sources, Stats) && Success;
+}
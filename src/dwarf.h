@@ -0,0 +1,54 @@
+//===---- dwarf.h - Rose DNA from the debug info of objects ---------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_DWARF_H
+#define ROSE_DNA_DWARF_H
+
+#include "dna.h"
+#include "stats.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+#include <vector>
+
+/** Fills the DNA from the DWARF of objects built with -g instead of parsing
+ * the sources. Like the extraction from the AST, a struct is added for each
+ * typedef of a record declared at the top level (or in a namespace), the
+ * layouts are the ones the objects were compiled with. The alignments DWARF
+ * does not record follow the ABI of the target of the object, they are 0 for
+ * targets whose rules are not known. */
+class DWARFExtractor {
+public:
+  /** Number of objects read in parallel, 0 uses every hardware thread. */
+  unsigned Threads = 0;
+  /** When not empty, only the typedefs declared in these files (absolute
+   * paths) are extracted. */
+  llvm::StringSet<> Headers;
+  /** Optional statistics, each object and the merge are recorded in it. */
+  DNAStats *Stats = nullptr;
+
+  /** Extract \a Objects in \a DNA, returns false when an object can not be
+   * read or when two compile units disagree on the layout of a struct. */
+  bool run(llvm::ArrayRef<std::string> Objects, SDNA *DNA);
+
+  /** Absolute path of the file each struct of the last run() is declared
+   * in, empty when the DWARF does not tell. */
+  DNASources Sources;
+
+private:
+  /** Every compile unit of \a Object is a shard of its own, \a Origins names
+   * them and \a UnitSources has the files of their structs. */
+  llvm::Error extract(const std::string &Object, std::vector<SDNA> &Shards,
+                      std::vector<std::string> &Origins,
+                      std::vector<std::vector<std::string>> &UnitSources);
+};
+
+#endif // ROSE_DNA_DWARF_H
@@ -0,0 +1,481 @@
+//===---- extract.cpp - Extraction of rose DNA from translation units -----===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "extract.h"
+#include "layout.h"
+#include "trace.h"
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/Utils.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+using namespace clang;
+using namespace clang::ast_matchers;
+using namespace clang::tooling;
+using namespace llvm;
+
+namespace {
+class TypedefDeclCallback : public MatchFinder::MatchCallback {
+public:
+  TypedefDeclCallback(TypedefExtractor *Typedefs) : Typedefs(Typedefs) {}
+
+  void run(const MatchFinder::MatchResult &Result) override {
+    if (auto *TD = Result.Nodes.getNodeAs<clang::TypedefDecl>("typedef")) {
+      Typedefs->extract(TD);
+    }
+  }
+
+private:
+  TypedefExtractor *Typedefs;
+};
+
+/** Records every file a translation unit includes, system headers too since
+ * they take part in the layouts. */
+class IncludeCollector : public DependencyCollector {
+public:
+  bool needSystemDependencies() override { return true; }
+};
+
+class DependencyCallbacks : public SourceFileCallbacks {
+public:
+  bool handleBeginSource(CompilerInstance &CI) override {
+    Instance = &CI;
+    Collector = std::make_shared<IncludeCollector>();
+    Collector->attachToPreprocessor(CI.getPreprocessor());
+    return true;
+  }
+
+  void handleEndSource() override {
+    for (const std::string &Dependency : Collector->getDependencies()) {
+      SmallString<256> Path(Dependency);
+      Instance->getFileManager().makeAbsolutePath(Path);
+      llvm::sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+      Dependencies.push_back(std::string(Path.str()));
+    }
+    Collector.reset();
+  }
+
+  /** Absolute paths of the files included by the last translation unit. */
+  std::vector<std::string> Dependencies;
+
+private:
+  CompilerInstance *Instance = nullptr;
+  std::shared_ptr<IncludeCollector> Collector;
+};
+
+/** What an ExtractAction hands its translation unit to. */
+typedef struct ExtractConsumers {
+  /** The generic matcher, the top level visitor is used when it is null. */
+  MatchFinder *Finder;
+  TypedefExtractor *Typedefs;
+  DependencyCallbacks *Dependencies;
+  /** Build the whole AST like clang does. */
+  bool FullFrontend;
+  /** Receives the memory allocated by the ASTContext. */
+  uint64_t *ASTBytes;
+} ExtractConsumers;
+
+/** Frontend action that only does the work the layouts need: function bodies
+ * are skipped, warnings and typo correction are turned off. */
+class ExtractAction : public ASTFrontendAction {
+public:
+  ExtractAction(const ExtractConsumers &Consumers) : Consumers(Consumers) {}
+
+protected:
+  bool BeginInvocation(CompilerInstance &CI) override {
+    if (!Consumers.FullFrontend) {
+      /** Sema still parses constexpr functions and functions with a deduced
+       * return type, the ones a layout can depend on. */
+      CI.getFrontendOpts().SkipFunctionBodies = true;
+      CI.getLangOpts().SpellChecking = false;
+      CI.getDiagnostics().setIgnoreAllWarnings(true);
+    }
+    return ASTFrontendAction::BeginInvocation(CI);
+  }
+
+  bool BeginSourceFileAction(CompilerInstance &CI) override {
+    return Consumers.Dependencies->handleBeginSource(CI);
+  }
+
+  void EndSourceFileAction() override {
+    CompilerInstance &CI = getCompilerInstance();
+    if (CI.hasASTContext()) {
+      *Consumers.ASTBytes = CI.getASTContext().getASTAllocatedMemory();
+    }
+    Consumers.Dependencies->handleEndSource();
+  }
+
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
+                                                 StringRef InFile) override {
+    if (Consumers.Finder) {
+      return Consumers.Finder->newASTConsumer();
+    }
+    return std::make_unique<TopLevelConsumer>(Consumers.Typedefs);
+  }
+
+private:
+  ExtractConsumers Consumers;
+};
+
+class ExtractActionFactory : public FrontendActionFactory {
+public:
+  ExtractActionFactory(const ExtractConsumers &Consumers)
+      : Consumers(Consumers) {}
+
+  std::unique_ptr<FrontendAction> create() override {
+    return std::make_unique<ExtractAction>(Consumers);
+  }
+
+private:
+  ExtractConsumers Consumers;
+};
+
+/** Writes the precompiled header of the input in a fixed file, the driver
+ * drops -o from syntax only commands. */
+class GeneratePreambleAction : public GeneratePCHAction {
+public:
+  GeneratePreambleAction(const std::string &Output,
+                         DependencyCallbacks *Dependencies)
+      : Output(Output), Dependencies(Dependencies) {}
+
+protected:
+  bool BeginInvocation(CompilerInstance &CI) override {
+    CI.getFrontendOpts().OutputFile = Output;
+    return GeneratePCHAction::BeginInvocation(CI);
+  }
+
+  bool BeginSourceFileAction(CompilerInstance &CI) override {
+    return GeneratePCHAction::BeginSourceFileAction(CI) &&
+           Dependencies->handleBeginSource(CI);
+  }
+
+  void EndSourceFileAction() override {
+    Dependencies->handleEndSource();
+    GeneratePCHAction::EndSourceFileAction();
+  }
+
+private:
+  std::string Output;
+  DependencyCallbacks *Dependencies;
+};
+
+class GeneratePreambleActionFactory : public FrontendActionFactory {
+public:
+  GeneratePreambleActionFactory(const std::string &Output,
+                                DependencyCallbacks *Dependencies)
+      : Output(Output), Dependencies(Dependencies) {}
+
+  std::unique_ptr<FrontendAction> create() override {
+    return std::make_unique<GeneratePreambleAction>(Output, Dependencies);
+  }
+
+private:
+  std::string Output;
+  DependencyCallbacks *Dependencies;
+};
+} // end anonymous namespace
+
+/** Replace the target of the command line by \a Triple. */
+static ArgumentsAdjuster TargetAdjuster(const std::string &Triple) {
+  return [Triple](const CommandLineArguments &Args, StringRef Filename) {
+    CommandLineArguments Adjusted;
+    for (size_t Index = 0; Index < Args.size(); Index++) {
+      StringRef Arg = Args[Index];
+      if (Index > 0 && (Arg == "-target" || Arg == "--target")) {
+        Index++;
+        continue;
+      }
+      if (Arg.startswith("--target=") || Arg.startswith("-target=")) {
+        continue;
+      }
+      Adjusted.push_back(Args[Index]);
+      if (Index == 0) {
+        Adjusted.push_back("--target=" + Triple);
+      }
+    }
+    return Adjusted;
+  };
+}
+
+/** Files only mapped in memory can not be hashed from the disk. */
+static std::vector<std::string>
+OnDiskDependencies(ArrayRef<std::string> Dependencies,
+                   const StringMap<std::string> &VirtualFiles) {
+  std::vector<std::string> OnDisk;
+  for (const std::string &Dependency : Dependencies) {
+    if (!VirtualFiles.count(Dependency)) {
+      OnDisk.push_back(Dependency);
+    }
+  }
+  return OnDisk;
+}
+
+DNAExtractor::DNAExtractor(const CompilationDatabase &Compilations)
+    : Compilations(Compilations) {}
+
+/** Each worker needs its own file system, the working directory of the
+ * compile commands is not shared between threads. */
+std::unique_ptr<ClangTool>
+DNAExtractor::createTool(const CompilationDatabase &ToolCompilations,
+                         const std::string &File) const {
+  IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS =
+      llvm::vfs::createPhysicalFileSystem();
+  auto Tool = std::make_unique<ClangTool>(
+      ToolCompilations, ArrayRef<std::string>(File),
+      std::make_shared<PCHContainerOperations>(), FS);
+  for (const auto &VirtualFile : VirtualFiles) {
+    Tool->mapVirtualFile(VirtualFile.getKey(), VirtualFile.getValue());
+  }
+  if (!Target.empty()) {
+    Tool->appendArgumentsAdjuster(TargetAdjuster(Target));
+  }
+  return Tool;
+}
+
+bool DNAExtractor::buildPreamble(const CompilationDatabase &PreambleCompilations,
+                                 const std::string &File,
+                                 const std::string &Output) {
+  llvm::TimeTraceScope Scope("Build preamble", File);
+  std::unique_ptr<ClangTool> Tool = createTool(PreambleCompilations, File);
+
+  DependencyCallbacks Dependencies;
+  GeneratePreambleActionFactory Factory(Output, &Dependencies);
+  if (Tool->run(&Factory)) {
+    return false;
+  }
+
+  Preamble = Output;
+  PreambleDependencies =
+      OnDiskDependencies(Dependencies.Dependencies, VirtualFiles);
+  return true;
+}
+
+bool DNAExtractor::parse(const std::string &File, bool UsePreamble,
+                         SDNA *Shard, std::vector<std::string> &Dependencies,
+                         std::vector<std::string> &ShardSources,
+                         DNAUnitStats &Unit) {
+  llvm::TimeTraceScope Scope(UsePreamble ? "Parse with preamble" : "Parse",
+                             File);
+  std::unique_ptr<ClangTool> Tool = createTool(Compilations, File);
+
+  IgnoringDiagConsumer Ignore;
+  if (UsePreamble) {
+    Tool->appendArgumentsAdjuster(getInsertArgumentAdjuster(
+        {"-include-pch", Preamble}, ArgumentInsertPosition::BEGIN));
+    /** A translation unit the preamble does not fit is parsed again without
+     * it, only the diagnostics of that second parse are worth reporting. */
+    Tool->setDiagnosticConsumer(&Ignore);
+  }
+
+  TypedefExtractor Typedefs(Shard, Headers.empty() ? nullptr : &Headers);
+  TypedefDeclCallback Callback(&Typedefs);
+  ast_matchers::MatchFinder Finder;
+  Finder.addMatcher(typedefDecl().bind("typedef"), &Callback);
+
+  DependencyCallbacks Callbacks;
+  ExtractConsumers Consumers = {Engine == DNAEngine::Matcher ? &Finder : nullptr,
+                                &Typedefs, &Callbacks, FullFrontend,
+                                &Unit.ASTBytes};
+  ExtractActionFactory Factory(Consumers);
+  int Status = Tool->run(&Factory);
+  Unit.Typedefs = Typedefs.Stats;
+  if (Status) {
+    return false;
+  }
+
+  Dependencies = OnDiskDependencies(Callbacks.Dependencies, VirtualFiles);
+  ShardSources = Typedefs.Sources;
+  if (UsePreamble) {
+    /** The headers of the preamble are not included again by the
+     * translation unit, they still are part of its inputs. */
+    Dependencies.insert(Dependencies.end(), PreambleDependencies.begin(),
+                        PreambleDependencies.end());
+  }
+  return true;
+}
+
+bool DNAExtractor::extract(const std::string &File, SDNA *Shard,
+                           std::vector<std::string> &ShardSources) {
+  llvm::TimeTraceScope Scope("Extract", File);
+
+  /** Files only mapped in memory are part of the key since they can not be
+   * hashed from the disk. */
+  auto Virtual = VirtualFiles.find(File);
+  StringRef Contents;
+  if (Virtual != VirtualFiles.end()) {
+    Contents = Virtual->second;
+  }
+
+  std::string Key;
+  if (Cache) {
+    Key = Cache->key(Compilations, File, Contents.str() + Configuration);
+    llvm::TimeTraceScope CacheScope("Load cache", File);
+    auto Start = std::chrono::steady_clock::now();
+    if (!Key.empty() && Cache->load(Key, Shard, ShardSources)) {
+      if (Stats) {
+        DNAUnitStats Unit;
+        Unit.File = File;
+        Unit.Cached = true;
+        Unit.Seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - Start)
+                           .count();
+        Stats->recordUnit(Unit);
+      }
+      return true;
+    }
+  }
+
+  Parsed++;
+  auto Start = std::chrono::steady_clock::now();
+  /** The time stamps of the files are compared to the wall clock. */
+  llvm::sys::TimePoint<> Started = std::chrono::system_clock::now();
+
+  std::vector<std::string> Dependencies;
+  DNAUnitStats Unit;
+  Unit.File = File;
+  bool Success = false;
+  if (!Preamble.empty()) {
+    Success = parse(File, /*UsePreamble=*/true, Shard, Dependencies,
+                    ShardSources, Unit);
+    if (Success) {
+      PreambleReused++;
+    } else {
+      DNA_free(Shard);
+    }
+  }
+  if (!Success && !parse(File, /*UsePreamble=*/false, Shard, Dependencies,
+                         ShardSources, Unit)) {
+    return false;
+  }
+
+  Unit.Seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - Start)
+          .count();
+  if (Timings) {
+    Timings->record(File, Unit.Seconds);
+  }
+  if (Stats) {
+    Stats->recordUnit(Unit);
+  }
+  if (Cache && !Key.empty()) {
+    llvm::TimeTraceScope CacheScope("Store cache", File);
+    Cache->store(Key, Shard, Dependencies, ShardSources, Started);
+  }
+  return true;
+}
+
+/** Every translation unit is extracted in its own SDNA shard by the worker
+ * threads, the shards are then merged in the order of \a Files so the result
+ * does not depend on the number of threads or on the scheduling. Structs seen
+ * by several translation units are only kept once, layout mismatches are
+ * reported as ODR conflicts. */
+bool DNAExtractor::run(ArrayRef<std::string> Files, SDNA *DNA) {
+  {
+    llvm::ThreadPool Pool(llvm::hardware_concurrency(Threads));
+    start(Pool, Files);
+    Pool.wait();
+  }
+  return finish(DNA);
+}
+
+/** The extractors of every target report their failures concurrently. */
+static std::mutex ErrorMutex;
+
+bool DNA_merge_shards(ArrayRef<DNAShard> Shards, SDNA *DNA,
+                      DNASources &Sources, DNAStats *Stats) {
+  llvm::TimeTraceScope Scope("Merge");
+  auto Start = std::chrono::steady_clock::now();
+  bool Success = true;
+  DNAMerger Merger(DNA);
+  for (const DNAShard &Shard : Shards) {
+    if (!Merger.merge(Shard.DNA, Shard.Origin, Shard.Sources)) {
+      Success = false;
+    }
+  }
+  Sources = std::move(Merger.Sources);
+  if (Stats) {
+    Stats->recordPhase("merge", std::chrono::duration<double>(
+                                    std::chrono::steady_clock::now() - Start)
+                                    .count());
+  }
+
+  std::lock_guard<std::mutex> Lock(ErrorMutex);
+  for (const DNAConflict &Conflict : Merger.Conflicts) {
+    llvm::errs() << "ODR conflict: " << Conflict.Name << " in "
+                 << Conflict.Origin << " does not match the layout from "
+                 << Conflict.KeptOrigin << "\n";
+  }
+  return Success && Merger.Conflicts.empty();
+}
+
+void DNAExtractor::start(llvm::ThreadPool &Pool, ArrayRef<std::string> Files) {
+  /** What is extracted from a translation unit depends on these too. */
+  std::vector<std::string> Sorted;
+  for (const auto &Header : Headers) {
+    Sorted.push_back(Header.getKey().str());
+  }
+  std::sort(Sorted.begin(), Sorted.end());
+  Configuration = Engine == DNAEngine::Matcher ? "\nmatcher" : "\nvisitor";
+  Configuration += "\n" + Target;
+  for (const std::string &Header : Sorted) {
+    Configuration += "\n" + Header;
+  }
+
+  Units.assign(Files.begin(), Files.end());
+  Shards.assign(Files.size(), SDNA{NULL, 0});
+  ShardSources.assign(Files.size(), std::vector<std::string>());
+  Failed = false;
+
+  /** The longest translation units are started first, otherwise one of them
+   * started last keeps a single thread busy while the others are idle. The
+   * order of the shards does not change. */
+  std::vector<size_t> Order;
+  if (Timings) {
+    Order = Timings->schedule(Files);
+  } else {
+    for (size_t Index = 0; Index < Files.size(); Index++) {
+      Order.push_back(Index);
+    }
+  }
+
+  for (size_t Index : Order) {
+    Pool.async([this, Index]() {
+      TimeTraceTask Task;
+      if (!extract(Units[Index], &Shards[Index], ShardSources[Index])) {
+        std::lock_guard<std::mutex> Lock(ErrorMutex);
+        llvm::errs() << "Failed to extract DNA from " << Units[Index]
+                     << "\n";
+        Failed = true;
+      }
+    });
+  }
+}
+
+bool DNAExtractor::finish(SDNA *DNA) {
+  std::vector<DNAShard> Merged;
+  for (size_t Index = 0; Index < Units.size(); Index++) {
+    Merged.push_back({&Shards[Index], Units[Index], &ShardSources[Index]});
+  }
+  bool Success = DNA_merge_shards(Merged, DNA, Sources, Stats) && !Failed;
+  Shards.clear();
+  ShardSources.clear();
+  return Success;
+}
@@ -0,0 +1,134 @@
+//===---- extract.h - Extraction of rose DNA from translation units -------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_EXTRACT_H
+#define ROSE_DNA_EXTRACT_H
+
+#include "cache.h"
+#include "dna.h"
+#include "stats.h"
+#include "timings.h"
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+/** The DNA of one translation unit or object, see DNAMerger::merge(). */
+typedef struct DNAShard {
+  SDNA *DNA;
+  std::string Origin;
+  const std::vector<std::string> *Sources;
+} DNAShard;
+
+/** Merge \a Shards with a DNAMerger in their order, the result does not
+ * depend on which thread filled each shard. \a Sources receives the files of
+ * the kept structs and \a Stats, when given, the time of the merge. The ODR
+ * conflicts are reported, returns false on a conflict or when out of memory.
+ */
+bool DNA_merge_shards(llvm::ArrayRef<DNAShard> Shards, SDNA *DNA,
+                      DNASources &Sources, DNAStats *Stats);
+
+enum class DNAEngine {
+  /** Walks the top level declarations of each translation unit. */
+  Visitor,
+  /** Runs the typedefDecl() matcher over the whole AST. */
+  Matcher,
+};
+
+/** Runs the frontend on translation units and collects the DNA of the structs
+ * they declare. */
+class DNAExtractor {
+public:
+  DNAExtractor(const clang::tooling::CompilationDatabase &Compilations);
+
+  /** Number of worker threads, 0 uses every hardware thread. */
+  unsigned Threads = 0;
+  /** Optional cache of the DNA of each translation unit. */
+  DNACache *Cache = nullptr;
+  /** Optional history of the frontend time of each translation unit, the
+   * longest ones are started first and the parsed ones are recorded. */
+  DNATimings *Timings = nullptr;
+  /** Optional statistics, each translation unit and the merge are recorded
+   * in it. */
+  DNAStats *Stats = nullptr;
+  /** Build the whole AST like clang does, function bodies included, instead
+   * of the lean frontend action. */
+  bool FullFrontend = false;
+  DNAEngine Engine = DNAEngine::Visitor;
+  /** When not empty, only the typedefs declared in these files (absolute
+   * paths) are extracted. */
+  llvm::StringSet<> Headers;
+  /** Target triple the layouts are computed for, the target of the compile
+   * commands when empty. */
+  std::string Target;
+  /** Files that only exist in memory, mapped over the real file system. */
+  llvm::StringMap<std::string> VirtualFiles;
+
+  /** Build a precompiled header of \a File in \a Output, run() then tries to
+   * parse every translation unit on top of it. */
+  bool buildPreamble(
+      const clang::tooling::CompilationDatabase &PreambleCompilations,
+      const std::string &File, const std::string &Output);
+
+  /** Extract \a Files in \a DNA, returns false when a translation unit failed
+   * or when two of them disagree on the layout of a struct. */
+  bool run(llvm::ArrayRef<std::string> Files, SDNA *DNA);
+  /** What run() does in two steps, so that the extractors of several targets
+   * can share \a Pool: start() queues the translation units on it and
+   * finish() merges them in \a DNA once the pool is done. */
+  void start(llvm::ThreadPool &Pool, llvm::ArrayRef<std::string> Files);
+  bool finish(SDNA *DNA);
+
+  /** Absolute path of the file each struct of the last run() is declared
+   * in. */
+  DNASources Sources;
+
+  /** Translation units that were not found in the cache. */
+  std::atomic<unsigned> Parsed{0};
+  /** Translation units parsed on top of the preamble. */
+  std::atomic<unsigned> PreambleReused{0};
+
+private:
+  std::unique_ptr<clang::tooling::ClangTool>
+  createTool(const clang::tooling::CompilationDatabase &ToolCompilations,
+             const std::string &File) const;
+  /** Extract a single translation unit in \a Shard, \a ShardSources
+   * receives the file each of its structs is declared in. */
+  bool extract(const std::string &File, SDNA *Shard,
+               std::vector<std::string> &ShardSources);
+  /** Run the frontend on \a File, \a Dependencies receives the files it
+   * includes and \a Unit what the frontend and the extraction did. */
+  bool parse(const std::string &File, bool UsePreamble, SDNA *Shard,
+             std::vector<std::string> &Dependencies,
+             std::vector<std::string> &ShardSources, DNAUnitStats &Unit);
+
+  const clang::tooling::CompilationDatabase &Compilations;
+
+  /** Salt of the cache keys, see run(). */
+  std::string Configuration;
+
+  std::string Preamble;
+  std::vector<std::string> PreambleDependencies;
+
+  /** The translation units queued by start() and their shards. */
+  std::vector<std::string> Units;
+  std::vector<SDNA> Shards;
+  std::vector<std::vector<std::string>> ShardSources;
+  std::atomic<bool> Failed{false};
+};
+
+#endif // ROSE_DNA_EXTRACT_H
@@ -0,0 +1,45 @@
+//===---- headerlist.cpp - The --header-list file -------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "headerlist.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+using namespace llvm;
+
+Expected<std::vector<std::string>> readHeaderList(StringRef Path) {
+  auto Buffer = MemoryBuffer::getFile(Path);
+  if (!Buffer) {
+    return make_error<StringError>("Failed to read the header list " + Path +
+                                       ": " + Buffer.getError().message(),
+                                   Buffer.getError());
+  }
+
+  SmallString<256> Directory(Path);
+  sys::fs::make_absolute(Directory);
+  sys::path::remove_filename(Directory);
+
+  std::vector<std::string> Headers;
+  SmallVector<StringRef, 64> Lines;
+  (*Buffer)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty=*/false);
+  for (StringRef Line : Lines) {
+    Line = Line.trim();
+    if (Line.empty() || Line[0] == '#') {
+      continue;
+    }
+    SmallString<256> Header(Line);
+    sys::fs::make_absolute(Directory, Header);
+    sys::path::remove_dots(Header, /*remove_dot_dot=*/true);
+    Headers.push_back(std::string(Header.str()));
+  }
+  return std::move(Headers);
+}
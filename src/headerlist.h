@@ -0,0 +1,26 @@
+//===---- headerlist.h - The --header-list file ---------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  Shared by rose-dna and RoseDNAPlugin, it only depends on LLVMSupport.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_HEADERLIST_H
+#define ROSE_DNA_HEADERLIST_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+#include <vector>
+
+/** Read a list of headers, one per line, empty lines and lines starting with
+ * '#' are ignored. Relative paths are relative to the list. */
+llvm::Expected<std::vector<std::string>> readHeaderList(llvm::StringRef Path);
+
+#endif // ROSE_DNA_HEADERLIST_H
@@ -0,0 +1,254 @@
+//===---- layout.cpp - DNA structs from the typedefs of records ----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "layout.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TimeProfiler.h"
+
+using namespace clang;
+using namespace llvm;
+
+/** Name of the struct of \a RD, for the struct itself and for the fields of
+ * its type alike: the spelling of the canonical record, whichever typedef or
+ * scope it was named through. An anonymous record is spelled after its
+ * typedef. */
+static std::string StructName(const ASTContext &CTX, const RecordDecl *RD) {
+  return CTX.getRecordType(RD).getAsString();
+}
+
+TypedefExtractor::TypedefExtractor(SDNA *DNA, const StringSet<> *Headers)
+    : DNA(DNA), Headers(Headers) {}
+
+std::string TypedefExtractor::filename(const SourceManager &SM,
+                                       SourceLocation Loc) const {
+  SmallString<256> Path(SM.getFilename(SM.getExpansionLoc(Loc)));
+  SM.getFileManager().makeAbsolutePath(Path);
+  sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+  return std::string(Path.str());
+}
+
+bool TypedefExtractor::accept(const TypedefDecl *TD) {
+  SourceLocation Loc = TD->getLocation();
+  if (Loc.isInvalid()) {
+    /** Implicit typedefs of clang have no location. */
+    return false;
+  }
+  if (!Headers) {
+    return true;
+  }
+
+  const SourceManager &SM = TD->getASTContext().getSourceManager();
+  Loc = SM.getExpansionLoc(Loc);
+  FileID File = SM.getFileID(Loc);
+
+  bool Accepted;
+  auto It = Files.find(File);
+  if (It != Files.end()) {
+    Accepted = It->second;
+  } else {
+    Accepted = Headers->count(filename(SM, Loc)) != 0;
+    Files[File] = Accepted;
+  }
+  return Accepted;
+}
+
+void TypedefExtractor::extract(const TypedefDecl *TD) {
+  if (!accept(TD)) {
+    if (TD->getLocation().isInvalid()) {
+      Stats.Implicit++;
+    } else {
+      Stats.OutsideHeaders++;
+    }
+    return;
+  }
+
+  ASTContext &CTX = TD->getASTContext();
+
+  QualType Qual = TD->getUnderlyingType();
+  auto *RD = Qual->getAsRecordDecl();
+
+  if (!RD) {
+    Stats.NotRecord++;
+  } else {
+    if (!RD->getBeginLoc().isValid()) {
+      /** Clang builtin types are annoying. */
+      Stats.Builtin++;
+      return;
+    }
+    if (!Records.insert(RD->getCanonicalDecl()).second) {
+      /** Another typedef of the same record, the record is the identity of
+       * the struct not the name of the typedef. */
+      Stats.Duplicate++;
+      return;
+    }
+    Stats.Accepted++;
+
+    std::string Name = StructName(CTX, RD);
+    llvm::TimeTraceScope Scope("Layout", Name);
+    DNAStruct *Struct = DNA_add_struct(DNA, Name);
+    Sources.push_back(filename(CTX.getSourceManager(), TD->getLocation()));
+
+    Struct->size = CTX.getTypeInfo(Qual).Width / 8;
+
+    for (auto *FD : RD->fields()) {
+      QualType FieldQual = FD->getType();
+      size_t size = CTX.getTypeInfo(FieldQual).Width / 8;
+      size_t align = CTX.getTypeInfo(FieldQual).Align / 8;
+      size_t offset = CTX.getFieldOffset(FD);
+
+      DNAField *Field = DNA_add_field(DNA, Struct, FD->getNameAsString());
+      Stats.Fields++;
+
+      Field->size = size;
+      Field->align = align;
+      Field->offset = offset;
+
+      /** Conventional so that single items can be multiplied. */
+      Field->array = 1;
+
+      if (FieldQual->isPointerType()) {
+        Field->flags |= DNA_FIELD_IS_POINTER;
+      }
+      if (FieldQual->isFunctionPointerType()) {
+        Field->flags |= DNA_FIELD_IS_FUNCTION;
+      }
+
+      QualType TypeQual;
+      if (FieldQual->isPointerType() || FieldQual->isFunctionPointerType()) {
+        /** This should be treated as a pointer. */
+        TypeQual = FieldQual->getPointeeType();
+      } else if (FieldQual->isArrayType()) {
+        /** This should be treated as an array. */
+
+        /** Find the simplest element type of arrays. */
+        const clang::ArrayType *AT = FieldQual->getAsArrayTypeUnsafe();
+        while (AT->getElementType()->isArrayType()) {
+          AT = AT->getElementType()->getAsArrayTypeUnsafe();
+        }
+        QualType ArrayElementQual = AT->getElementType();
+        size_t elem_size = CTX.getTypeInfo(ArrayElementQual).Width / 8;
+
+        Field->array = size / elem_size;
+
+        if (ArrayElementQual->isPointerType()) {
+          Field->flags |= DNA_FIELD_IS_POINTER;
+
+          TypeQual = ArrayElementQual->getPointeeType();
+        } else {
+          TypeQual = ArrayElementQual;
+        }
+      } else {
+        /** Treat as a normal buffer of bytes. */
+        TypeQual = FieldQual;
+      }
+
+      std::string tp = TypeQual.getAsString();
+      Field->type = DNA_intern(DNA, tp.c_str(), tp.size());
+      Field->type_id = resolve(CTX, TypeQual);
+    }
+  }
+}
+
+int TypedefExtractor::resolve(ASTContext &CTX, QualType Type) {
+  const clang::Type *T = Type.getCanonicalType().getTypePtr();
+  if (const auto *ET = dyn_cast<EnumType>(T)) {
+    /** An enum is its underlying integer. */
+    QualType Integer = ET->getDecl()->getIntegerType();
+    if (!Integer.isNull()) {
+      T = Integer.getCanonicalType().getTypePtr();
+    }
+  }
+
+  if (T->isFunctionType()) {
+    return DNA_add_type(DNA, DNA_TYPE_FUNCTION, QualType(T, 0).getAsString(),
+                        0, -1);
+  }
+  if (T->isVoidType()) {
+    return DNA_add_type(DNA, DNA_TYPE_PRIMITIVE, "", 0, DNA_PRIMITIVE_VOID);
+  }
+  int Size = T->isIncompleteType() || T->isDependentType()
+                 ? 0
+                 : (int)CTX.getTypeSizeInChars(T).getQuantity();
+
+  int Primitive = -1;
+  if (T->isAnyPointerType() || T->isBlockPointerType() ||
+      T->isMemberPointerType() || T->isReferenceType()) {
+    Primitive = DNA_PRIMITIVE_POINTER;
+  } else if (T->isBooleanType()) {
+    Primitive = DNA_PRIMITIVE_BOOL;
+  } else if (T->isIntegerType()) {
+    Primitive = DNA_primitive_integer(T->isSignedIntegerType(), Size);
+  } else if (T->isRealFloatingType()) {
+    const fltSemantics *Semantics = &CTX.getFloatTypeSemantics(QualType(T, 0));
+    if (Semantics == &APFloat::IEEEhalf()) {
+      Primitive = DNA_PRIMITIVE_FLOAT16;
+    } else if (Semantics == &APFloat::IEEEsingle()) {
+      Primitive = DNA_PRIMITIVE_FLOAT32;
+    } else if (Semantics == &APFloat::IEEEdouble()) {
+      Primitive = DNA_PRIMITIVE_FLOAT64;
+    } else if (Semantics == &APFloat::x87DoubleExtended()) {
+      Primitive = DNA_PRIMITIVE_FLOAT80;
+    } else if (Semantics == &APFloat::IEEEquad()) {
+      Primitive = DNA_PRIMITIVE_FLOAT128;
+    }
+  }
+  if (Primitive >= 0) {
+    return DNA_add_type(DNA, DNA_TYPE_PRIMITIVE, "", Size, Primitive);
+  }
+
+  if (const auto *RT = dyn_cast<RecordType>(T)) {
+    return DNA_add_type(DNA, DNA_TYPE_STRUCT, StructName(CTX, RT->getDecl()),
+                        Size, -1);
+  }
+  return DNA_add_type(DNA, DNA_TYPE_OPAQUE, QualType(T, 0).getAsString(), Size,
+                      -1);
+}
+
+TopLevelConsumer::TopLevelConsumer(TypedefExtractor *Typedefs)
+    : Typedefs(Typedefs) {}
+
+bool TopLevelConsumer::HandleTopLevelDecl(DeclGroupRef Group) {
+  for (Decl *D : Group) {
+    visit(D);
+  }
+  return true;
+}
+
+void TopLevelConsumer::HandleTranslationUnit(ASTContext &Context) {
+  if (Context.getExternalSource()) {
+    /** The declarations loaded from a precompiled header are never handed to
+     * HandleTopLevelDecl, walk the top level again in order. Pending is
+     * dropped so that each typedef is extracted, and counted, once. */
+    Pending.clear();
+    for (Decl *D : Context.getTranslationUnitDecl()->decls()) {
+      visit(D);
+    }
+  }
+  flush();
+}
+
+void TopLevelConsumer::flush() {
+  for (const TypedefDecl *TD : Pending) {
+    Typedefs->extract(TD);
+  }
+  Pending.clear();
+}
+
+void TopLevelConsumer::visit(Decl *D) {
+  if (auto *TD = dyn_cast<TypedefDecl>(D)) {
+    Pending.push_back(TD);
+  } else if (isa<LinkageSpecDecl>(D) || isa<NamespaceDecl>(D)) {
+    for (Decl *Child : cast<DeclContext>(D)->decls()) {
+      visit(Child);
+    }
+  }
+}
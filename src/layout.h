@@ -0,0 +1,84 @@
+//===---- layout.h - DNA structs from the typedefs of records -------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_LAYOUT_H
+#define ROSE_DNA_LAYOUT_H
+
+#include "dna.h"
+#include "stats.h"
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/Decl.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <string>
+#include <vector>
+
+/** Turns the typedefs of records into DNA structs. The identity of a struct is
+ * its record, several typedefs of the same record only add it once. */
+class TypedefExtractor {
+public:
+  /** Only typedefs declared in \a Headers are extracted when it is given, the
+   * paths are absolute. */
+  TypedefExtractor(SDNA *DNA, const llvm::StringSet<> *Headers = nullptr);
+
+  /** Whether the file \a TD is declared in takes part in the DNA, only looks
+   * at the location of \a TD so it is cheap. Nothing is counted, extract()
+   * counts the typedefs it rejects. */
+  bool accept(const clang::TypedefDecl *TD);
+
+  /** Add the struct of \a TD when it is an accepted typedef of a record. */
+  void extract(const clang::TypedefDecl *TD);
+
+  /** Absolute path of the file each extracted struct is declared in, in the
+   * order of the structs. */
+  std::vector<std::string> Sources;
+  TypedefStats Stats;
+
+private:
+  /** Index of \a Type in the types of the DNA. */
+  int resolve(clang::ASTContext &CTX, clang::QualType Type);
+
+  /** Absolute path of the file \a Loc expands in. */
+  std::string filename(const clang::SourceManager &SM,
+                       clang::SourceLocation Loc) const;
+
+  SDNA *DNA;
+  const llvm::StringSet<> *Headers;
+
+  llvm::SmallPtrSet<const clang::RecordDecl *, 64> Records;
+  llvm::DenseMap<clang::FileID, bool> Files;
+};
+
+/** Only visits the declarations at the top level of the translation unit
+ * (and of the extern "C" blocks and namespaces in it), function bodies are
+ * never walked. The typedefs are collected as they come, they are filtered
+ * and their layouts computed once the translation unit is complete since a
+ * typedef may name a record that is only defined later. */
+class TopLevelConsumer : public clang::ASTConsumer {
+public:
+  TopLevelConsumer(TypedefExtractor *Typedefs);
+
+  bool HandleTopLevelDecl(clang::DeclGroupRef Group) override;
+  void HandleTranslationUnit(clang::ASTContext &Context) override;
+
+  /** Extract the typedefs handed so far. */
+  void flush();
+
+private:
+  void visit(clang::Decl *D);
+
+  TypedefExtractor *Typedefs;
+  std::vector<const clang::TypedefDecl *> Pending;
+};
+
+#endif // ROSE_DNA_LAYOUT_H
@@ -33,8 +33,20 @@
 //
 //===----------------------------------------------------------------------===//
 
-#include "clang/ASTMatchers/ASTMatchFinder.h"
-#include "clang/ASTMatchers/ASTMatchers.h"
+#include "cache.h"
+#include "astfile.h"
+#include "dna.h"
+#include "dwarf.h"
+#include "extract.h"
+#include "headerlist.h"
+#include "scan.h"
+#include "server.h"
+#include "stats.h"
+#include "timings.h"
+#include "trace.h"
+#include "watch.h"
+#include "umbrella.h"
+
 #include "clang/Basic/SourceManager.h"
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Lex/Lexer.h"
@@ -43,267 +55,979 @@
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Tooling/Refactoring/AtomicChange.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/GlobPattern.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/TimeProfiler.h"
 
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <iterator>
 
 using namespace clang;
 using namespace clang::ast_matchers;
 using namespace clang::tooling;
 using namespace llvm;
 
-/** The reason offset, size and array ar integers is because we want to have the
- * same time in both x86 and x64. */
-
-typedef struct DNAField {
-  char name[64];
-  /** Use with caution this might not exist in SDNA. */
-  char type[64];
-
-  int offset;
-  int size;
-  int align;
-  int array;
-
-  int flags;
-} DNAField;
-
-enum {
-  /** This field is a pointer, if this is an array too the elements of the array
-     are pointers. */
-  DNA_FIELD_IS_POINTER = (1 << 0),
-  /** This field is an array, use the #DNAField->array to get the size of the
-     array. */
-  DNA_FIELD_IS_ARRAY = (1 << 1),
-  /** This field is a pointer to a function (since all structures are in C). */
-  DNA_FIELD_IS_FUNCTION = (1 << 2),
-};
+// Set up the command line options
+static cl::extrahelp CommonHelp(CommonOptionsParser::HelpMessage);
+static cl::OptionCategory ToolTemplateCategory("rose-dna options");
+
+static cl::opt<std::string>
+    DNAOutput("dna", cl::desc(R"(Specify the output file for rose DNA.)"),
+             cl::init("clang-rose.dna"), cl::cat(ToolTemplateCategory));
+
+static cl::opt<unsigned>
+    Jobs("jobs",
+         cl::desc(R"(Number of translation units to extract in parallel,
+0 uses every hardware thread.)"),
+         cl::init(0), cl::cat(ToolTemplateCategory));
+static cl::alias JobsShort("j", cl::desc("Alias for --jobs"),
+                           cl::aliasopt(Jobs));
+
+static cl::opt<std::string>
+    CacheDir("cache-dir",
+             cl::desc(R"(Directory where the DNA of each translation unit is
+cached, a translation unit is only parsed again when its
+compile command or one of the files it includes changed.)"),
+             cl::cat(ToolTemplateCategory));
+
+static cl::opt<std::string>
+    TimingHistory("timings",
+                  cl::desc(R"(History of the frontend time of each translation
+unit, the longest ones are started first. Kept in
+--cache-dir by default, not kept without either.)"),
+                  cl::value_desc("file"), cl::cat(ToolTemplateCategory));
+
+static cl::list<std::string>
+    Headers("headers",
+            cl::desc(R"(Comma separated list of DNA headers, only a single
+translation unit including them is parsed. It is compiled
+with the command of the first source file.)"),
+            cl::CommaSeparated, cl::cat(ToolTemplateCategory));
+
+static cl::opt<std::string>
+    HeaderList("header-list",
+               cl::desc(R"(File listing DNA headers one per line, see
+--headers.)"),
+               cl::cat(ToolTemplateCategory));
+
+static cl::opt<bool>
+    UsePreamble("pch",
+                cl::desc(R"(Parse every source file on top of a precompiled
+header of --headers built once, instead of parsing the
+umbrella of the headers only.)"),
+                cl::cat(ToolTemplateCategory));
+
+static cl::opt<bool>
+    Prefilter("prefilter",
+              cl::desc(R"(With --headers, parse the source files instead of
+the umbrella of the headers, but only a small subset of
+them that includes every header. The includes are found
+with the dependency scanner, without parsing.)"),
+              cl::cat(ToolTemplateCategory));
+
+static cl::opt<bool>
+    FullFrontend("full-frontend",
+                 cl::desc(R"(Build the whole AST, function bodies included,
+instead of the lean frontend action.)"),
+                 cl::cat(ToolTemplateCategory));
+
+static cl::opt<DNAEngine> Engine(
+    "engine", cl::desc("How the typedefs are found in each translation unit."),
+    cl::values(clEnumValN(DNAEngine::Visitor, "visitor",
+                          "Walk the top level declarations only (default)."),
+               clEnumValN(DNAEngine::Matcher, "matcher",
+                          "Run the typedefDecl() matcher over the whole AST.")),
+    cl::init(DNAEngine::Visitor), cl::cat(ToolTemplateCategory));
+
+static cl::opt<bool>
+    Benchmark("benchmark",
+              cl::desc(R"(Time the extraction of the source files with each
+engine and frontend and report it, nothing is cached nor
+written.)"),
+              cl::cat(ToolTemplateCategory));
+
+static cl::list<std::string>
+    Targets("targets",
+            cl::desc(R"(Comma separated list of target triples, the layouts
+are extracted for each of them in a single run. Every
+translation unit is parsed once per target. The first
+target is written as the main DNA, the others follow in a
+per target section.)"),
+            cl::CommaSeparated, cl::cat(ToolTemplateCategory));
+
+static cl::opt<DNAFormat> Format(
+    "format", cl::desc("Format of the DNA files written."),
+    cl::values(clEnumValN(DNAFormat::Indexed, "v2",
+                          "Indexed, read in place once mapped (default)."),
+               clEnumValN(DNAFormat::Legacy, "legacy",
+                          "The \"SDNA\" stream, parsed from the start.")),
+    cl::init(DNAFormat::Indexed), cl::cat(ToolTemplateCategory));
+
+static cl::opt<std::string>
+    Depfile("depfile",
+            cl::desc(R"(Write a Make dependency file of the DNA output in this
+file, it lists every header a struct of the DNA is declared
+in.)"),
+            cl::cat(ToolTemplateCategory));
+
+static cl::opt<bool>
+    FromDwarf("from-dwarf",
+              cl::desc(R"(The paths are objects built with -g, the DNA is read
+from their DWARF instead of parsing the sources.)"),
+              cl::cat(ToolTemplateCategory));
+
+static cl::opt<std::string>
+    Shard("shard",
+          cl::desc(R"(Only extract the shard i of N of the translation units,
+i counts from 0. The output is sorted by struct name so
+that rose-dna-merge can combine the shards.)"),
+          cl::value_desc("i/N"), cl::cat(ToolTemplateCategory));
+
+static cl::opt<bool>
+    FromAST("from-ast",
+            cl::desc(R"(The paths are precompiled headers or AST files, the
+DNA is read from the serialized AST instead of parsing the
+sources.)"),
+            cl::cat(ToolTemplateCategory));
+
+static cl::opt<bool>
+    Serve("serve",
+          cl::desc(R"(Stay resident and answer requests on --socket, the
+compilation database and the hashes of the included files
+are kept between requests.)"),
+          cl::cat(ToolTemplateCategory));
+
+static cl::opt<std::string>
+    SocketPath("socket", cl::desc(R"(Unix domain socket of --serve.)"),
+               cl::init("rose-dna.sock"), cl::cat(ToolTemplateCategory));
+
+static cl::opt<bool>
+    Watch("watch",
+          cl::desc(R"(Stay resident and extract again whenever one of the
+headers the structs are declared in changes, only the
+translation units including it are parsed again.)"),
+          cl::cat(ToolTemplateCategory));
+
+static cl::list<std::string>
+    Split("split",
+          cl::desc(R"(Also write the structs declared in the headers matching
+glob in file, the DNA output stays complete. A relative
+glob is relative to the working directory, '*' matches '/'
+too. May be given several times, a struct goes in every
+file whose glob matches.)"),
+          cl::value_desc("glob=file"), cl::cat(ToolTemplateCategory));
+
+static cl::opt<std::string>
+    TimeTrace("time-trace",
+              cl::desc(R"(Write a Chrome trace JSON of the run in this file
+when rose-dna exits, with a span per translation unit,
+per header clang parses and per struct layout.)"),
+              cl::value_desc("file"), cl::cat(ToolTemplateCategory));
+
+static cl::opt<std::string>
+    StatsOutput("stats",
+                cl::desc(R"(Write statistics of each extraction in this JSON
+file: translation units, typedefs accepted and skipped,
+fields, output bytes, AST memory, time per phase and peak
+RSS.)"),
+                cl::value_desc("file"), cl::cat(ToolTemplateCategory));
+
+static cl::opt<unsigned>
+    TimeTraceGranularity("time-trace-granularity",
+                         cl::desc(R"(Minimum duration of a --time-trace span
+in microseconds.)"),
+                         cl::init(500), cl::cat(ToolTemplateCategory));
+
+/** A directory on the command line stands for every file of the compilation
+ * database that lives under it. */
+static std::vector<std::string>
+CollectTranslationUnits(const CompilationDatabase &Compilations,
+                        ArrayRef<std::string> SourcePaths) {
+  std::vector<std::string> Files;
+  llvm::StringSet<> Visited;
+
+  for (const std::string &Path : SourcePaths) {
+    if (!llvm::sys::fs::is_directory(Path)) {
+      if (Visited.insert(Path).second) {
+        Files.push_back(Path);
+      }
+      continue;
+    }
+
+    SmallString<256> Directory(Path);
+    llvm::sys::fs::make_absolute(Directory);
+    llvm::sys::path::remove_dots(Directory, /*remove_dot_dot=*/true);
+
+    for (const std::string &File : Compilations.getAllFiles()) {
+      if (File.size() > Directory.size() &&
+          File.compare(0, Directory.size(), Directory.str().str()) == 0 &&
+          llvm::sys::path::is_separator(File[Directory.size()]) &&
+          Visited.insert(File).second) {
+        Files.push_back(File);
+      }
+    }
+  }
+  return Files;
+}
 
-typedef struct DNAStruct {
-  char name[64];
+/** The files of shard \a Index of \a Count. The files are dealt in turn in
+ * the order of their paths, every process computes the same partition no
+ * matter the order of the compilation database. */
+static std::vector<std::string> SelectShard(ArrayRef<std::string> Files,
+                                            unsigned Index, unsigned Count) {
+  std::vector<std::string> Sorted(Files.begin(), Files.end());
+  std::sort(Sorted.begin(), Sorted.end());
+  llvm::StringSet<> Selected;
+  for (size_t Rank = Index; Rank < Sorted.size(); Rank += Count) {
+    Selected.insert(Sorted[Rank]);
+  }
 
-  int size;
+  std::vector<std::string> Result;
+  for (const std::string &File : Files) {
+    if (Selected.count(File)) {
+      Result.push_back(File);
+    }
+  }
+  return Result;
+}
 
-  DNAField *_Fields;
-  int _FieldsLen;
-} DNAStruct;
+/** Absolute paths of the headers of --headers and --header-list, in this
+ * order. */
+static Expected<std::vector<std::string>> CollectHeaders() {
+  std::vector<std::string> Result;
+  for (const std::string &Header : Headers) {
+    SmallString<256> Path(Header);
+    llvm::sys::fs::make_absolute(Path);
+    llvm::sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+    Result.push_back(std::string(Path.str()));
+  }
+  if (!HeaderList.empty()) {
+    auto List = readHeaderList(HeaderList);
+    if (!List) {
+      return List.takeError();
+    }
+    Result.insert(Result.end(), List->begin(), List->end());
+  }
+  return std::move(Result);
+}
+
+/** Extract \a Files with every engine and frontend in turn. The leanest one
+ * runs first so that it is the one paying for a cold file system cache, the
+ * last one is how rose-dna used to extract. */
+static int RunBenchmark(const CompilationDatabase &Compilations,
+                        ArrayRef<std::string> Files,
+                        const DNAExtractor &Settings) {
+  struct {
+    const char *Name;
+    DNAEngine Engine;
+    bool FullFrontend;
+    double Seconds;
+  } Variants[] = {
+      {"visitor, lean", DNAEngine::Visitor, false, 0.0},
+      {"matcher, lean", DNAEngine::Matcher, false, 0.0},
+      {"matcher, full", DNAEngine::Matcher, true, 0.0},
+  };
+  const size_t VariantsLen = sizeof(Variants) / sizeof(Variants[0]);
+
+  int ExitStatus = 0;
+  for (auto &Variant : Variants) {
+    DNAExtractor Extractor(Compilations);
+    Extractor.Threads = Jobs;
+    Extractor.Engine = Variant.Engine;
+    Extractor.FullFrontend = Variant.FullFrontend;
+    Extractor.Target = Settings.Target;
+    Extractor.Headers = Settings.Headers;
+    Extractor.VirtualFiles = Settings.VirtualFiles;
+
+    SDNA DNA;
+    memset(&DNA, 0, sizeof(SDNA));
 
-typedef struct SDNA {
-  DNAStruct *_Types;
-  int _TypesLen;
-} SDNA;
+    auto Start = std::chrono::steady_clock::now();
+    if (!Extractor.run(Files, &DNA)) {
+      ExitStatus = 1;
+    }
+    Variant.Seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - Start)
+                          .count();
+
+    llvm::outs() << llvm::format("%-16s %10.3fs %8d structs\n", Variant.Name,
+                                 Variant.Seconds, DNA._TypesLen);
+    DNA_free(&DNA);
+  }
+
+  llvm::outs() << Files.size() << " translation units, speedup over "
+               << Variants[VariantsLen - 1].Name << ":\n";
+  for (size_t Index = 0; Index + 1 < VariantsLen; Index++) {
+    llvm::outs() << llvm::format(
+        "%-16s %10.2fx\n", Variants[Index].Name,
+        Variants[VariantsLen - 1].Seconds / Variants[Index].Seconds);
+  }
+  return ExitStatus;
+}
+
+/** An output of --split, the structs declared in the files matching
+ * \a Patterns. */
+struct DNASplit {
+  std::string Path;
+  std::vector<GlobPattern> Patterns;
+};
+
+/** Group the --split options by output file, in the order of the files. */
+static Expected<std::vector<DNASplit>> CollectSplits() {
+  std::vector<DNASplit> Result;
+  for (const std::string &Value : Split) {
+    std::pair<StringRef, StringRef> Entry = StringRef(Value).rsplit('=');
+    if (Entry.first.empty() || Entry.second.empty()) {
+      return make_error<StringError>("--split expects glob=file: " + Value,
+                                     inconvertibleErrorCode());
+    }
+
+    /** A glob starting with a wildcard already matches absolute paths. */
+    SmallString<256> Glob(Entry.first);
+    if (!Glob.startswith("*")) {
+      llvm::sys::fs::make_absolute(Glob);
+    }
+    auto Pattern = GlobPattern::create(Glob);
+    if (!Pattern) {
+      return Pattern.takeError();
+    }
 
-DNAStruct *DNA_add_struct(SDNA *DNA, const std::string &name) {
-  size_t alloc = sizeof(DNAStruct) * (DNA->_TypesLen + 1);
-  DNAStruct *arr = (DNAStruct *)(realloc(DNA->_Types, alloc));
-  if (arr) {
-    DNAStruct *Struct = &((DNA->_Types = arr)[DNA->_TypesLen++]);
-    memset(Struct, 0, sizeof(DNAStruct));
-    strncpy(Struct->name, name.c_str(), sizeof(Struct->name));
-    return Struct;
+    auto It = std::find_if(Result.begin(), Result.end(),
+                           [&Entry](const DNASplit &Split) {
+                             return Split.Path == Entry.second;
+                           });
+    if (It == Result.end()) {
+      It = Result.insert(Result.end(), DNASplit{Entry.second.str(), {}});
+    }
+    It->Patterns.push_back(std::move(*Pattern));
   }
-  return NULL;
+  return std::move(Result);
 }
 
-DNAField *DNA_add_field(DNAStruct *Struct, const std::string &name) {
-  size_t alloc = sizeof(DNAField) * (Struct->_FieldsLen + 1);
-  DNAField *arr = (DNAField *)(realloc(Struct->_Fields, alloc));
-  if (arr) {
-    DNAField *Field = &((Struct->_Fields = arr)[Struct->_FieldsLen++]);
-    memset(Field, 0, sizeof(DNAField));
-    strncpy(Field->name, name.c_str(), sizeof(Struct->name));
-    return Field;
+/** What every extraction of a run shares, a resident rose-dna keeps it
+ * between requests. */
+struct DNASession {
+  const CompilationDatabase *Compilations = nullptr;
+  std::vector<std::string> Files;
+  std::vector<std::string> Headers;
+  UmbrellaUnit Umbrella;
+  DNACache *Cache = nullptr;
+  DNATimings *Timings = nullptr;
+  std::string TimingsPath;
+  /** An empty triple keeps the target of the compile commands. */
+  std::vector<std::string> Triples;
+  std::vector<DNASplit> Splits;
+  /** Time spent selecting the translation units with --prefilter. */
+  double PrefilterSeconds = 0.0;
+};
+
+static void ConfigureExtractor(DNAExtractor &Extractor,
+                               const DNASession &Session,
+                               const std::string &Triple) {
+  Extractor.Threads = Jobs;
+  Extractor.Cache = Session.Cache;
+  Extractor.Timings = Session.Timings;
+  Extractor.Engine = Engine;
+  Extractor.FullFrontend = FullFrontend;
+  Extractor.Target = Triple;
+  for (const std::string &Header : Session.Headers) {
+    Extractor.Headers.insert(Header);
+  }
+  if (Session.Umbrella.Compilations) {
+    Extractor.VirtualFiles[Session.Umbrella.Path] = Session.Umbrella.Contents;
   }
-  return NULL;
 }
 
-namespace {
-class TypedefDeclCallback : public MatchFinder::MatchCallback {
-public:
-  TypedefDeclCallback(SDNA *DNA, ExecutionContext &Context)
-      : Context(Context), DNA(DNA) {}
+/** What ExtractTargets() did besides filling the tables. */
+struct ExtractReport {
+  /** Translation units that were not replayed from the cache. */
+  unsigned Parsed = 0;
+  /** Files the structs of every target are declared in, sorted. */
+  std::vector<std::string> Sources;
+  /** File each struct is declared in, the first target tells. */
+  DNASources StructSources;
+  DNAStats Stats;
+};
 
-  void run(const MatchFinder::MatchResult &Result) override {
-    if (auto *TD = Result.Nodes.getNodeAs<clang::TypedefDecl>("typedef")) {
-      ASTContext &CTX = TD->getASTContext();
+/** Add the files of the structs of an extraction to \a Report. */
+static void ReportSources(ExtractReport &Report, const DNASources &Sources) {
+  std::vector<std::string> Files;
+  for (const auto &Source : Sources) {
+    Report.StructSources.emplace(Source.first, Source.second);
+    if (!Source.second.empty()) {
+      Files.push_back(Source.second);
+    }
+  }
+  std::sort(Files.begin(), Files.end());
+  Files.erase(std::unique(Files.begin(), Files.end()), Files.end());
 
-      QualType Qual = TD->getUnderlyingType();
-      auto *RD = Qual->getAsRecordDecl();
+  std::vector<std::string> Union;
+  std::set_union(Report.Sources.begin(), Report.Sources.end(), Files.begin(),
+                 Files.end(), std::back_inserter(Union));
+  Report.Sources = std::move(Union);
+}
 
-      if (RD) {
-        if (!RD->getBeginLoc().isValid()) {
-          /** Clang builtin types are annoying. */
-          return;
-        }
+/** Extract the DNA of every target of \a Session in \a Tables. An AST is
+ * laid out for a single target, so every translation unit is still parsed
+ * once per target. What does not depend on the target is only done once for
+ * all of them: the translation units, the prefilter scan, the headers and the
+ * umbrella come from the session, the hashes of the included files from its
+ * cache. The preambles of the targets are built in parallel and the
+ * translation units of every target share one thread pool, so no target
+ * waits for the slowest translation unit of the previous one. */
+static int ExtractTargets(const DNASession &Session,
+                          std::vector<DNATarget> &Tables,
+                          ExtractReport *Report) {
+  size_t TargetsLen = Session.Triples.size();
+  std::vector<std::unique_ptr<DNAExtractor>> Extractors;
+  for (const std::string &Triple : Session.Triples) {
+    Extractors.push_back(
+        std::make_unique<DNAExtractor>(*Session.Compilations));
+    ConfigureExtractor(*Extractors.back(), Session, Triple);
+    if (Report) {
+      Extractors.back()->Stats = &Report->Stats;
+    }
+  }
 
-        DNAStruct *Struct = DNA_add_struct(DNA, Qual.getAsString());
-
-        Struct->size = CTX.getTypeInfo(Qual).Width / 8;
-
-        for (auto *FD : RD->fields()) {
-          QualType FieldQual = FD->getType();
-          size_t size = CTX.getTypeInfo(FieldQual).Width / 8;
-          size_t align = CTX.getTypeInfo(FieldQual).Align / 8;
-          size_t offset = CTX.getFieldOffset(FD);
-
-          DNAField *Field = DNA_add_field(Struct, FD->getNameAsString());
-
-          Field->size = size;
-          Field->align = align;
-          Field->offset = offset;
-
-          /** Conventional so that single items can be multiplied. */
-          Field->array = 1;
-
-          if (FieldQual->isPointerType()) {
-            Field->flags |= DNA_FIELD_IS_POINTER;
-          }
-          if (FieldQual->isFunctionPointerType()) {
-            Field->flags |= DNA_FIELD_IS_FUNCTION;
-          }
-
-          if (FieldQual->isPointerType() || FieldQual->isFunctionPointerType()) {
-            /** This should be treated as a pointer. */
-            QualType PointeeQual = FieldQual->getPointeeType();
-            std::string tp = PointeeQual.getAsString();
-            strncpy(Field->type, tp.c_str(), sizeof(Field->type));
-          } else if (FieldQual->isArrayType()) {
-            /** This should be treated as an array. */
-
-            /** Find the simplest element type of arrays. */
-            const clang::ArrayType *AT = FieldQual->getAsArrayTypeUnsafe();
-            while (AT->getElementType()->isArrayType()) {
-              AT = AT->getElementType()->getAsArrayTypeUnsafe();
-            }
-            QualType ArrayElementQual = AT->getElementType();
-            size_t elem_size = CTX.getTypeInfo(ArrayElementQual).Width / 8;
-
-            Field->array = size / elem_size;
-
-            if (ArrayElementQual->isPointerType()) {
-              Field->flags |= DNA_FIELD_IS_POINTER;
-
-              QualType PointeeQual = ArrayElementQual->getPointeeType();
-              std::string tp = PointeeQual.getAsString();
-              strncpy(Field->type, tp.c_str(), sizeof(Field->type));
-            } else {
-              std::string tp = ArrayElementQual.getAsString();
-              strncpy(Field->type, tp.c_str(), sizeof(Field->type));
-            }
-          } else {
-            /** Treat as a normal buffer of bytes. */
-            std::string tp = FieldQual.getAsString();
-            strncpy(Field->type, tp.c_str(), sizeof(Field->type));
-          }
+  /** The headers are parsed once in the preamble, every translation unit
+   * then loads it instead of parsing them again. A preamble only fits the
+   * target it was built for. */
+  std::vector<llvm::FileRemover> PreambleRemovers(TargetsLen);
+  std::vector<std::string> PreamblePaths(TargetsLen);
+  std::vector<double> PreambleSeconds(TargetsLen, 0.0);
+  std::vector<char> PreambleBuilt(TargetsLen, false);
+  int ExitStatus = 0;
+  {
+    llvm::ThreadPool Pool(llvm::hardware_concurrency(Jobs));
+    if (UsePreamble) {
+      for (size_t Target = 0; Target < TargetsLen; Target++) {
+        SmallString<256> PreamblePath;
+        if (llvm::sys::fs::createTemporaryFile("rose-dna-preamble", "pch",
+                                               PreamblePath)) {
+          llvm::errs() << "Failed to create the preamble file, every source "
+                          "file is parsed from scratch.\n";
+          continue;
         }
+        PreambleRemovers[Target].setFile(PreamblePath);
+        PreamblePaths[Target] = std::string(PreamblePath.str());
+        Pool.async([&, Target]() {
+          TimeTraceTask Task;
+          auto Start = std::chrono::steady_clock::now();
+          PreambleBuilt[Target] = Extractors[Target]->buildPreamble(
+              *Session.Umbrella.Compilations, Session.Umbrella.Path,
+              PreamblePaths[Target]);
+          PreambleSeconds[Target] = std::chrono::duration<double>(
+                                        std::chrono::steady_clock::now() -
+                                        Start)
+                                        .count();
+        });
       }
+      Pool.wait();
+      for (size_t Target = 0; Target < TargetsLen; Target++) {
+        if (!PreamblePaths[Target].empty() && !PreambleBuilt[Target]) {
+          llvm::errs() << "Failed to build the preamble, every source file "
+                          "is parsed from scratch.\n";
+        }
+        if (Report) {
+          Report->Stats.recordPhase("preamble", PreambleSeconds[Target]);
+        }
+      }
+    }
+
+    llvm::TimeTraceScope Scope("Extract targets");
+    auto Start = std::chrono::steady_clock::now();
+    for (const auto &Extractor : Extractors) {
+      Extractor->start(Pool, Session.Files);
+    }
+    Pool.wait();
+    if (Report) {
+      Report->Stats.recordPhase(
+          "extract", std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - Start)
+                         .count());
     }
   }
 
-private:
-  ExecutionContext &Context;
-  SDNA *DNA;
-};
-} // end anonymous namespace
+  for (size_t Target = 0; Target < TargetsLen; Target++) {
+    DNAExtractor &Extractor = *Extractors[Target];
+    const std::string &Triple = Session.Triples[Target];
+    DNATarget Table;
+    Table.Triple = Triple;
+    memset(&Table.DNA, 0, sizeof(SDNA));
+    if (!Extractor.finish(&Table.DNA)) {
+      ExitStatus = 1;
+    }
+    /** The output then does not depend on the order of the translation
+     * units, the fields stay in declaration order, that is the layout. */
+    DNA_sort(&Table.DNA);
+    Tables.push_back(Table);
+    if (Report) {
+      Report->Parsed += Extractor.Parsed;
+      ReportSources(*Report, Extractor.Sources);
+    }
 
-// Set up the command line options
-static cl::extrahelp CommonHelp(CommonOptionsParser::HelpMessage);
-static cl::OptionCategory ToolTemplateCategory("rose-dna options");
+    if (UsePreamble) {
+      /** Not measured: it assumes that every translation unit that loaded
+       * the preamble would have parsed the headers for as long as the
+       * preamble took to build. */
+      unsigned Reused = Extractor.PreambleReused;
+      double Estimate = PreambleSeconds[Target] * Reused -
+                        PreambleSeconds[Target];
+      if (!Triple.empty()) {
+        llvm::outs() << Triple << ": ";
+      }
+      llvm::outs() << llvm::format(
+          "Preamble of %u headers built in %.3fs, reused by %u of %u parsed "
+          "translation units (estimate, not measured: %.3fs of header "
+          "parsing saved if each reuse saves one build).\n",
+          (unsigned)Session.Headers.size(), PreambleSeconds[Target], Reused,
+          (unsigned)Extractor.Parsed, Estimate > 0.0 ? Estimate : 0.0);
+    }
+  }
 
-static cl::opt<std::string>
-    DNAOutput("dna", cl::desc(R"(Specify the output file for rose DNA.)"),
-             cl::init("clang-rose.dna"), cl::cat(ToolTemplateCategory));
+  if (Session.Timings && !Session.Timings->save(Session.TimingsPath)) {
+    llvm::errs() << "Failed to write the timings in " << Session.TimingsPath
+                 << "\n";
+  }
+  return ExitStatus;
+}
+
+/** Replace \a Path with \a Contents through a temporary file, readers never
+ * see it half written. \a Path is left alone, time stamp included, when it
+ * already holds \a Contents so that nothing depending on it is rebuilt. */
+static int WriteFileIfChanged(const std::string &Path, StringRef Contents) {
+  auto Existing = llvm::MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                              /*RequiresNullTerminator=*/false);
+  if (Existing && (*Existing)->getBuffer() == Contents) {
+    return 0;
+  }
+
+  if (Error E = llvm::writeFileAtomically(Path + ".tmp%%%%%%%%", Path,
+                                          Contents)) {
+    llvm::errs() << "Failed to write " << Path << ": "
+                 << llvm::toString(std::move(E)) << "\n";
+    return -2;
+  }
+  return 0;
+}
+
+static int WriteDNA(const std::vector<DNATarget> &Tables,
+                    const std::string &DNAFile, DNAStats &Stats) {
+  llvm::TimeTraceScope Scope("Write DNA", DNAFile);
+  std::vector<unsigned char> _BufferOut;
+  if (Format == DNAFormat::Indexed) {
+    DNA_write_indexed(Tables, _BufferOut);
+  } else if (Targets.empty()) {
+    DNA_write(&Tables.front().DNA, _BufferOut);
+  } else {
+    DNA_write_targets(Tables, _BufferOut);
+  }
+  Stats.recordOutput(DNAFile, _BufferOut.size(), &Tables.front().DNA);
+  return WriteFileIfChanged(
+      DNAFile, StringRef((const char *)_BufferOut.data(), _BufferOut.size()));
+}
+
+/** Escape \a Path for a Make rule, like clang does for its own dependency
+ * files. */
+static std::string EscapeMakePath(StringRef Path) {
+  std::string Escaped;
+  for (char C : Path) {
+    if (C == ' ' || C == '#') {
+      Escaped.push_back('\\');
+    } else if (C == '$') {
+      Escaped.push_back('$');
+    }
+    Escaped.push_back(C);
+  }
+  return Escaped;
+}
+
+/** Make rule of the DNA output on the headers its structs come from, Ninja
+ * then only runs rose-dna again when one of them changed. Every header is
+ * also given an empty rule so that removing one does not break the build. */
+static int WriteDepfile(const ExtractReport &Report) {
+  if (Depfile.empty()) {
+    return 0;
+  }
 
-/** Does not include the null terminator */
-void WriteWordOut(std::vector<unsigned char> &Buffer, const std::string &Word) {
-  unsigned char *raw = (unsigned char *)Word.c_str();
-  for (unsigned char *itr = raw; itr != raw + Word.size(); itr++) {
-    Buffer.push_back(*itr);
+  std::string Rule = EscapeMakePath(DNAOutput.getValue()) + ":";
+  for (const std::string &Source : Report.Sources) {
+    Rule += " \\\n  " + EscapeMakePath(Source);
   }
+  Rule += "\n";
+  for (const std::string &Source : Report.Sources) {
+    Rule += "\n" + EscapeMakePath(Source) + ":\n";
+  }
+
+  return WriteFileIfChanged(Depfile, Rule);
 }
 
-/** Does include the null terminator */
-void WriteStringOut(std::vector<unsigned char> &Buffer, const std::string &Word) {
-  unsigned char *raw = (unsigned char *)Word.c_str();
-  for (unsigned char *itr = raw; itr != raw + Word.size(); itr++) {
-    Buffer.push_back(*itr);
+static void FreeTables(std::vector<DNATarget> &Tables) {
+  for (DNATarget &Table : Tables) {
+    DNA_free(&Table.DNA);
   }
-  Buffer.push_back((unsigned char)'\0');
+  Tables.clear();
 }
 
-void WriteIntOut(std::vector<unsigned char> &Buffer, int value) {
-  unsigned char *raw = (unsigned char *)&value;
-  for (unsigned char *itr = raw; itr != raw + sizeof(value); itr++) {
-    Buffer.push_back(*itr);
+/** Write the files of --split, every target of \a Tables keeps the structs
+ * whose file matches a glob of the split, in the same order. */
+static int WriteSplits(const std::vector<DNASplit> &Splits,
+                       const std::vector<DNATarget> &Tables,
+                       ExtractReport &Report) {
+  for (const DNASplit &Split : Splits) {
+    std::vector<DNATarget> Subset;
+    for (const DNATarget &Table : Tables) {
+      DNATarget SubsetTable;
+      SubsetTable.Triple = Table.Triple;
+      memset(&SubsetTable.DNA, 0, sizeof(SDNA));
+      for (const DNAStruct *Struct = Table.DNA._Types;
+           Struct != Table.DNA._Types + Table.DNA._TypesLen; ++Struct) {
+        auto Source =
+            Report.StructSources.find(DNA_string(&Table.DNA, Struct->name));
+        if (Source == Report.StructSources.end() ||
+            std::none_of(Split.Patterns.begin(), Split.Patterns.end(),
+                         [&Source](const GlobPattern &Pattern) {
+                           return Pattern.match(Source->second);
+                         })) {
+          continue;
+        }
+        DNA_copy_struct(&SubsetTable.DNA, &Table.DNA, Struct);
+      }
+      Subset.push_back(SubsetTable);
+    }
+
+    int ExitStatus = WriteDNA(Subset, Split.Path, Report.Stats);
+    FreeTables(Subset);
+    if (ExitStatus != 0) {
+      return ExitStatus;
+    }
   }
+  return 0;
+}
+
+/** Write the DNA output, the splits, the dependency file and the
+ * statistics. */
+static int WriteOutputs(const DNASession &Session,
+                        const std::vector<DNATarget> &Tables,
+                        ExtractReport &Report) {
+  auto Start = std::chrono::steady_clock::now();
+  int ExitStatus = WriteDNA(Tables, DNAOutput.getValue(), Report.Stats);
+  if (ExitStatus == 0) {
+    ExitStatus = WriteSplits(Session.Splits, Tables, Report);
+  }
+  if (ExitStatus == 0) {
+    ExitStatus = WriteDepfile(Report);
+  }
+  Report.Stats.recordPhase("write", std::chrono::duration<double>(
+                                        std::chrono::steady_clock::now() -
+                                        Start)
+                                        .count());
+
+  if (!StatsOutput.empty() && !Report.Stats.write(StatsOutput)) {
+    llvm::errs() << "Failed to write the statistics in " << StatsOutput
+                 << "\n";
+  }
+  return ExitStatus;
+}
+
+/** Serve requests until shutdown, the compilation database, the umbrella and
+ * the cache of the session stay loaded in between. */
+static int RunServer(const DNASession &Session) {
+  DNAServer Server(SocketPath, [&Session](SDNA *DNA, std::string &Summary) {
+    std::vector<DNATarget> Tables;
+    ExtractReport Report;
+    int ExitStatus = ExtractTargets(Session, Tables, &Report);
+    if (ExitStatus == 0) {
+      ExitStatus = WriteOutputs(Session, Tables, Report);
+    }
+
+    /** Lookups are answered from the main table. */
+    *DNA = Tables.front().DNA;
+    memset(&Tables.front().DNA, 0, sizeof(SDNA));
+    FreeTables(Tables);
+
+    Summary = std::to_string(DNA->_TypesLen) + " structs, " +
+              std::to_string(Report.Parsed) + " of " +
+              std::to_string(Session.Files.size() * Session.Triples.size()) +
+              " translation units parsed";
+    return ExitStatus == 0;
+  });
+  return Server.serve();
+}
+
+/** Extract, then extract again every time one of the files the structs come
+ * from changes. The headers of the header set are watched too, a struct can
+ * appear in them. Unchanged translation units are replayed from the cache, so
+ * only the shards of the ones including a changed header are rebuilt before
+ * the DNA is merged and written again. */
+static int RunWatch(const DNASession &Session) {
+  DNAWatcher Watcher;
+  if (!Watcher.init()) {
+    llvm::errs() << "--watch needs inotify.\n";
+    return 1;
+  }
+
+  std::vector<std::string> Watched;
+  while (true) {
+    auto Start = std::chrono::steady_clock::now();
+
+    std::vector<DNATarget> Tables;
+    ExtractReport Report;
+    int ExitStatus = ExtractTargets(Session, Tables, &Report);
+    if (ExitStatus == 0) {
+      ExitStatus = WriteOutputs(Session, Tables, Report);
+    }
+    llvm::errs() << llvm::format(
+        "%s %d structs, %u translation units parsed in %.3fs\n",
+        ExitStatus == 0 ? "Wrote" : "Failed,", Tables.front().DNA._TypesLen,
+        Report.Parsed,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                      Start)
+            .count());
+    FreeTables(Tables);
+
+    /** A header being edited may not compile yet, keep watching what was
+     * watched until the extraction succeeds again. */
+    if (ExitStatus == 0 || Watched.empty()) {
+      Watched = Report.Sources;
+      Watched.insert(Watched.end(), Session.Headers.begin(),
+                     Session.Headers.end());
+    }
+    if (Watched.empty()) {
+      llvm::errs() << "No header to watch.\n";
+      return 1;
+    }
+    Watcher.watch(Watched);
+
+    std::vector<std::string> Changed = Watcher.wait();
+    if (Changed.empty()) {
+      llvm::errs() << "Failed to wait for changes.\n";
+      return 1;
+    }
+    for (const std::string &File : Changed) {
+      llvm::errs() << "Changed " << File << "\n";
+    }
+  }
+}
+
+/** Extract the DNA of files that are not compiled, objects or serialized
+ * ASTs, with \a Extractor. The headers only filter the typedefs. */
+template <typename PrebuiltExtractor>
+static int RunOnPrebuilt(PrebuiltExtractor &Extractor,
+                         ArrayRef<std::string> Files,
+                         const DNASession &Session) {
+  Extractor.Threads = Jobs;
+  for (const std::string &Header : Session.Headers) {
+    Extractor.Headers.insert(Header);
+  }
+
+  ExtractReport Report;
+  Extractor.Stats = &Report.Stats;
+
+  std::vector<DNATarget> Tables(1);
+  memset(&Tables.front().DNA, 0, sizeof(SDNA));
+  auto Start = std::chrono::steady_clock::now();
+  int ExitStatus = Extractor.run(Files, &Tables.front().DNA) ? 0 : 1;
+  Report.Stats.recordPhase("extract",
+                           std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - Start)
+                               .count());
+  DNA_sort(&Tables.front().DNA);
+  ReportSources(Report, Extractor.Sources);
+  int WriteStatus = WriteOutputs(Session, Tables, Report);
+  if (WriteStatus != 0) {
+    ExitStatus = WriteStatus;
+  }
+  FreeTables(Tables);
+  return ExitStatus;
 }
 
 int main(int argc, const char **argv) {
   llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
 
-  auto Executor = clang::tooling::createExecutorFromCommandLineArgs(
-      argc, argv, ToolTemplateCategory);
+  /** Objects and ASTs have no compile command, an empty fixed compilation
+   * database saves looking for one. */
+  std::vector<const char *> Arguments(argv, argv + argc);
+  auto IsArgument = [&Arguments](StringRef Name) {
+    return std::any_of(Arguments.begin(), Arguments.end(),
+                       [Name](const char *Arg) { return Name == Arg; });
+  };
+  if ((IsArgument("--from-dwarf") || IsArgument("--from-ast")) &&
+      !IsArgument("--")) {
+    Arguments.push_back("--");
+  }
+  argc = (int)Arguments.size();
+
+  auto OptionsParser =
+      CommonOptionsParser::create(argc, Arguments.data(), ToolTemplateCategory);
 
-  if (!Executor) {
-    llvm::errs() << llvm::toString(Executor.takeError()) << "\n";
+  if (!OptionsParser) {
+    llvm::errs() << llvm::toString(OptionsParser.takeError()) << "\n";
     return 1;
   }
 
-  SDNA DNA;
-  memset(&DNA, 0, sizeof(SDNA));
+  TimeTraceSession Trace(TimeTrace, TimeTraceGranularity,
+                         llvm::sys::path::filename(argv[0]));
 
-  ast_matchers::MatchFinder Finder;
-  TypedefDeclCallback Callback(&DNA, *Executor->get()->getExecutionContext());
-  Finder.addMatcher(typedefDecl().bind("typedef"), &Callback);
+  DNASession Session;
+  Session.Compilations = &OptionsParser->getCompilations();
+  Session.Files = CollectTranslationUnits(*Session.Compilations,
+                                          OptionsParser->getSourcePathList());
 
-  auto Err = Executor->get()->execute(newFrontendActionFactory(&Finder));
-  if (Err) {
-    llvm::errs() << llvm::toString(std::move(Err)) << "\n";
+  auto DNAHeaders = CollectHeaders();
+  if (!DNAHeaders) {
+    llvm::errs() << llvm::toString(DNAHeaders.takeError()) << "\n";
+    return 1;
   }
+  Session.Headers = std::move(*DNAHeaders);
 
-  std::vector<unsigned char> _BufferOut;
-  /** Can be read as int32, to recognize the endianess. */
-  WriteWordOut(_BufferOut, "SDNA");
+  auto Splits = CollectSplits();
+  if (!Splits) {
+    llvm::errs() << llvm::toString(Splits.takeError()) << "\n";
+    return 1;
+  }
+  Session.Splits = std::move(*Splits);
 
-  WriteIntOut(_BufferOut, DNA._TypesLen);
-  for (DNAStruct *Struct = DNA._Types; Struct != DNA._Types + DNA._TypesLen;
-       ++Struct) {
-    WriteStringOut(_BufferOut, Struct->name);
-    WriteIntOut(_BufferOut, Struct->size);
+  if (FromDwarf) {
+    DWARFExtractor Extractor;
+    return RunOnPrebuilt(Extractor, OptionsParser->getSourcePathList(),
+                         Session);
+  }
+  if (FromAST) {
+    ASTFileExtractor Extractor;
+    return RunOnPrebuilt(Extractor, OptionsParser->getSourcePathList(),
+                         Session);
+  }
 
-    WriteIntOut(_BufferOut, Struct->_FieldsLen);
-    for (DNAField *Field = Struct->_Fields;
-         Field != Struct->_Fields + Struct->_FieldsLen; ++Field) {
-      WriteStringOut(_BufferOut, Field->name);
-      WriteStringOut(_BufferOut, Field->type);
-      WriteIntOut(_BufferOut, Field->offset);
-      WriteIntOut(_BufferOut, Field->size);
-      WriteIntOut(_BufferOut, Field->align);
-      WriteIntOut(_BufferOut, Field->array);
-      WriteIntOut(_BufferOut, Field->flags);
+  /** With a header set a single umbrella translation unit is parsed in place
+   * of the source files, the first one lends its compile command. */
+  if (!Session.Headers.empty()) {
+    if (Session.Files.empty()) {
+      llvm::errs() << "No source file to borrow the compile command from.\n";
+      return 1;
+    }
+    auto Unit = createUmbrellaUnit(*Session.Compilations, Session.Files.front(),
+                                   Session.Headers);
+    if (!Unit) {
+      llvm::errs() << llvm::toString(Unit.takeError()) << "\n";
+      return 1;
     }
+    Session.Umbrella = std::move(*Unit);
+    if (Prefilter) {
+      auto Start = std::chrono::steady_clock::now();
+      size_t Scanned = Session.Files.size();
+      DNAScanner Scanner(*Session.Compilations);
+      Scanner.Threads = Jobs;
+      llvm::StringSet<> HeaderSet;
+      for (const std::string &Header : Session.Headers) {
+        HeaderSet.insert(Header);
+      }
+      Session.Files = Scanner.select(Session.Files, HeaderSet);
+      Session.PrefilterSeconds = std::chrono::duration<double>(
+                                     std::chrono::steady_clock::now() - Start)
+                                     .count();
+      llvm::outs() << llvm::format(
+          "Prefilter: %u of %u translation units include DNA headers, %u "
+          "parsed to cover %u headers.\n",
+          Scanner.Including, (unsigned)Scanned, (unsigned)Session.Files.size(),
+          (unsigned)(HeaderSet.size() - Scanner.Uncovered.size()));
+      for (const std::string &Header : Scanner.Uncovered) {
+        llvm::errs() << "No translation unit includes " << Header << "\n";
+      }
+    } else if (!UsePreamble) {
+      Session.Compilations = Session.Umbrella.Compilations.get();
+      Session.Files = {Session.Umbrella.Path};
+    }
+  } else if (UsePreamble) {
+    llvm::errs() << "--pch needs --headers or --header-list.\n";
+    return 1;
+  } else if (Prefilter) {
+    llvm::errs() << "--prefilter needs --headers or --header-list.\n";
+    return 1;
+  }
+
+  if (!Shard.empty()) {
+    std::pair<StringRef, StringRef> Value = StringRef(Shard).split('/');
+    unsigned Index, Count;
+    if (Value.first.getAsInteger(10, Index) ||
+        Value.second.getAsInteger(10, Count) || Count == 0 || Index >= Count) {
+      llvm::errs() << "--shard expects i/N with i < N.\n";
+      return 1;
+    }
+    if (!Targets.empty()) {
+      llvm::errs() << "--shard does not support --targets.\n";
+      return 1;
+    }
+    Session.Files = SelectShard(Session.Files, Index, Count);
   }
 
-  std::string DNAFile = DNAOutput.getValue();
+  /** A resident rose-dna keeps its cache in memory unless told otherwise. */
+  std::unique_ptr<DNACache> Cache;
+  if (!CacheDir.empty() || Serve || Watch) {
+    Cache = std::make_unique<DNACache>(CacheDir);
+    if (!Cache->init()) {
+      llvm::errs() << "Failed to create the cache directory " << CacheDir
+                   << ", the cache is disabled.\n";
+      Cache.reset();
+    }
+  }
+  Session.Cache = Cache.get();
 
-  int ExitStatus = 0;
-#if defined(WIN32) && WIN32
-  FILE *out = fopen(DNAFile.c_str(), "wb");
-#else
-  FILE *out = fopen(DNAFile.c_str(), "w");
-#endif
-  if (out) {
-    if (fwrite(_BufferOut.data(), 1, _BufferOut.size(), out) !=
-        _BufferOut.size()) {
-      std::cout << "Failed to write in output DNA file." << std::endl;
-      ExitStatus = -2;
-    }
-    fclose(out);
-  } else {
-    std::cout << "Failed to open output DNA file." << std::endl;
-    ExitStatus = -1;
+  /** Nothing but the outputs is written next to them, the history is only
+   * kept where asked for. */
+  DNATimings Timings;
+  if (!TimingHistory.empty()) {
+    Session.TimingsPath = TimingHistory;
+  } else if (!CacheDir.empty() && Session.Cache) {
+    SmallString<256> Path(CacheDir);
+    llvm::sys::path::append(Path, "timings");
+    Session.TimingsPath = std::string(Path.str());
+  }
+  if (!Session.TimingsPath.empty()) {
+    if (Timings.load(Session.TimingsPath)) {
+      Session.Timings = &Timings;
+    } else {
+      llvm::errs() << "Failed to read the timings in " << Session.TimingsPath
+                   << ", the translation units are started in order.\n";
+    }
+  }
+
+  Session.Triples.assign(Targets.begin(), Targets.end());
+  if (Session.Triples.empty()) {
+    Session.Triples.push_back(std::string());
+  }
+
+  if (Benchmark) {
+    DNAExtractor Extractor(*Session.Compilations);
+    ConfigureExtractor(Extractor, Session, Session.Triples.front());
+    return RunBenchmark(*Session.Compilations, Session.Files, Extractor);
+  }
+
+  if (Serve) {
+    return RunServer(Session);
+  }
+  if (Watch) {
+    return RunWatch(Session);
+  }
+
+  std::vector<DNATarget> Tables;
+  ExtractReport Report;
+  if (Prefilter) {
+    Report.Stats.recordPhase("prefilter", Session.PrefilterSeconds);
+  }
+  int ExitStatus = ExtractTargets(Session, Tables, &Report);
+  int WriteStatus = WriteOutputs(Session, Tables, Report);
+  if (WriteStatus != 0) {
+    ExitStatus = WriteStatus;
   }
+  FreeTables(Tables);
   return ExitStatus;
 }
@@ -0,0 +1,279 @@
+//===---- merge.cpp - Combine DNA fragments in a single DNA ---------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  Usage:
+//  rose-dna-merge -o <output> <fragment1> <fragment2> ...
+//
+//  Combines the DNA fragments written by the rose-dna clang plugin next to
+//  each object, usually at link time, or the DNA of the shards of rose-dna
+//  --shard. The output is sorted by struct name: the inputs are merged like
+//  sorted runs, a struct found in several inputs is kept once from the first
+//  of them and inputs that disagree on its layout are reported. Inputs whose
+//  structs are already sorted (the shards) are read one struct at a time, the
+//  others are read whole and sorted first. With --format=legacy each struct
+//  is written as it comes out of the merge, only the types are kept until the
+//  end. The indexed output needs the tables and the name index of the whole
+//  DNA, it is built in memory and written at the end. A list of inputs can be
+//  given in a response file with @<file>. The inputs may be in either format,
+//  the output is indexed unless --format=legacy.
+//
+//===----------------------------------------------------------------------===//
+
+#include "dna.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstring>
+#include <queue>
+
+using namespace llvm;
+
+static cl::OptionCategory MergeCategory("rose-dna-merge options");
+
+static cl::opt<std::string> Output("o", cl::desc("Output DNA file."),
+                                   cl::value_desc("file"), cl::Required,
+                                   cl::cat(MergeCategory));
+
+static cl::opt<DNAFormat> Format(
+    "format", cl::desc("Format of the output."),
+    cl::values(clEnumValN(DNAFormat::Indexed, "v2",
+                          "Indexed, read in place once mapped (default). The "
+                          "merged DNA is held in memory until it is written."),
+               clEnumValN(DNAFormat::Legacy, "legacy",
+                          "The \"SDNA\" stream, parsed from the start. Written "
+                          "as the structs are merged.")),
+    cl::init(DNAFormat::Indexed), cl::cat(MergeCategory));
+
+static cl::list<std::string> Fragments(cl::Positional,
+                                       cl::desc("<fragment>..."),
+                                       cl::OneOrMore, cl::cat(MergeCategory));
+
+namespace {
+/** A DNA being merged and its current struct. */
+class MergeInput {
+public:
+  MergeInput(const std::string &Path) : Path(Path) {
+    memset(&Current, 0, sizeof(SDNA));
+    memset(&Sorted, 0, sizeof(SDNA));
+  }
+
+  ~MergeInput() {
+    DNA_free(&Current);
+    DNA_free(&Sorted);
+  }
+
+  /** Returns false when the input can not be read. */
+  bool open() {
+    auto File = MemoryBuffer::getFile(Path);
+    if (!File) {
+      errs() << "Failed to read " << Path << ": " << File.getError().message()
+             << "\n";
+      return false;
+    }
+    Buffer = std::move(*File);
+    StringRef Bytes = Buffer->getBuffer();
+    Stream = std::make_unique<DNAStream>(Bytes.bytes_begin(), Bytes.size());
+    if (!Stream->begin()) {
+      errs() << Path << " is not a DNA.\n";
+      return false;
+    }
+    if (!Stream->sorted()) {
+      if (!DNA_read(&Sorted, Bytes.bytes_begin(), Bytes.size())) {
+        errs() << Path << " is not a DNA.\n";
+        return false;
+      }
+      DNA_sort(&Sorted);
+      Stream.reset();
+      Buffer.reset();
+    }
+    advance();
+    return !Broken;
+  }
+
+  /** Move to the next struct, returns false past the last one. */
+  bool advance() {
+    DNA_clear(&Current);
+    if (Stream) {
+      Valid = Stream->next(&Current);
+      if (Stream->failed()) {
+        errs() << Path << " is truncated or corrupt.\n";
+        Broken = true;
+      }
+      return Valid;
+    }
+    Valid = SortedIndex < Sorted._TypesLen;
+    if (Valid) {
+      Valid = DNA_copy_struct(&Current, &Sorted, &Sorted._Types[SortedIndex]);
+      SortedIndex++;
+    }
+    return Valid;
+  }
+
+  const DNAStruct *current() const { return &Current._Types[0]; }
+  const char *name() const { return DNA_string(&Current, current()->name); }
+  uint64_t fingerprint() const {
+    return DNA_struct_fingerprint(&Current, current());
+  }
+
+  std::string Path;
+  /** Holds the current struct only. */
+  SDNA Current;
+  bool Valid = false;
+  bool Broken = false;
+
+private:
+  std::unique_ptr<MemoryBuffer> Buffer;
+  std::unique_ptr<DNAStream> Stream;
+  SDNA Sorted;
+  int SortedIndex = 0;
+};
+} // end anonymous namespace
+
+int main(int argc, const char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  cl::HideUnrelatedOptions(MergeCategory);
+  cl::ParseCommandLineOptions(argc, argv, "Combine rose DNA fragments\n");
+
+  int ExitStatus = 0;
+  std::vector<std::unique_ptr<MergeInput>> Inputs;
+  for (const std::string &Fragment : Fragments) {
+    Inputs.push_back(std::make_unique<MergeInput>(Fragment));
+    if (!Inputs.back()->open()) {
+      ExitStatus = 1;
+    }
+  }
+
+  /** The smallest name on top, the first input on a tie. */
+  auto Greater = [&Inputs](size_t A, size_t B) {
+    int Order = strcmp(Inputs[A]->name(), Inputs[B]->name());
+    return Order > 0 || (Order == 0 && A > B);
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(Greater)> Heap(
+      Greater);
+  for (size_t Index = 0; Index < Inputs.size(); Index++) {
+    if (Inputs[Index]->Valid) {
+      Heap.push(Index);
+    }
+  }
+
+  /** The structs come out sorted. The legacy stream is written to a
+   * temporary file as they do, the indexed DNA gathers them here. */
+  SDNA Merged;
+  memset(&Merged, 0, sizeof(SDNA));
+  DNAStreamWriter Writer;
+  std::vector<unsigned char> _BufferOut;
+  std::unique_ptr<raw_fd_ostream> Out;
+  SmallString<256> TempPath;
+  FileRemover TempRemover;
+  if (Format == DNAFormat::Legacy) {
+    int FD;
+    if (std::error_code EC =
+            sys::fs::createUniqueFile(Output + ".tmp%%%%%%%%", FD, TempPath)) {
+      errs() << "Failed to write " << Output << ": " << EC.message() << "\n";
+      return 1;
+    }
+    TempRemover.setFile(TempPath);
+    Out = std::make_unique<raw_fd_ostream>(FD, /*shouldClose=*/true);
+    Writer.begin(_BufferOut);
+  }
+
+  std::vector<DNAConflict> Conflicts;
+  std::vector<size_t> Group;
+  while (!Heap.empty()) {
+    Group.clear();
+    Group.push_back(Heap.top());
+    Heap.pop();
+    while (!Heap.empty() &&
+           strcmp(Inputs[Heap.top()]->name(), Inputs[Group.front()]->name()) ==
+               0) {
+      Group.push_back(Heap.top());
+      Heap.pop();
+    }
+
+    MergeInput &Kept = *Inputs[Group.front()];
+    bool Added = Out ? Writer.add(&Kept.Current, Kept.current(), _BufferOut)
+                     : DNA_copy_struct(&Merged, &Kept.Current,
+                                       Kept.current()) != NULL;
+    if (!Added) {
+      errs() << "Out of memory\n";
+      return 1;
+    }
+    if (Out) {
+      Out->write((const char *)_BufferOut.data(), _BufferOut.size());
+      _BufferOut.clear();
+    }
+
+    std::string Name = Kept.name();
+    uint64_t Fingerprint = Kept.fingerprint();
+    for (size_t Index : Group) {
+      MergeInput &Input = *Inputs[Index];
+      bool First = &Input == &Kept;
+      /** Also drops the copies a single input would hold. */
+      do {
+        if (!First && Input.fingerprint() != Fingerprint) {
+          Conflicts.push_back({Name, Kept.Path, Input.Path});
+        }
+        First = false;
+      } while (Input.advance() && Name == Input.name());
+      if (Input.Valid) {
+        Heap.push(Index);
+      }
+    }
+  }
+  if (Out) {
+    int StructsLen = Writer.finish(_BufferOut);
+    Out->write((const char *)_BufferOut.data(), _BufferOut.size());
+    Out->pwrite((const char *)&StructsLen, sizeof(StructsLen),
+                DNAStreamWriter::CountOffset);
+  } else {
+    DNA_resolve_types(&Merged);
+    std::vector<DNATarget> Tables(1);
+    Tables.front().DNA = Merged;
+    DNA_write_indexed(Tables, _BufferOut);
+    DNA_free(&Merged);
+  }
+
+  for (const std::unique_ptr<MergeInput> &Input : Inputs) {
+    if (Input->Broken) {
+      ExitStatus = 1;
+    }
+  }
+  for (const DNAConflict &Conflict : Conflicts) {
+    errs() << "ODR conflict: " << Conflict.Name << " in " << Conflict.Origin
+           << " does not match the layout from " << Conflict.KeptOrigin
+           << "\n";
+    ExitStatus = 1;
+  }
+
+  if (Out) {
+    Out->close();
+    std::error_code EC = Out->error();
+    if (!EC) {
+      EC = sys::fs::rename(TempPath, Output);
+    }
+    if (EC) {
+      Out->clear_error();
+      errs() << "Failed to write " << Output << ": " << EC.message() << "\n";
+      return 1;
+    }
+    TempRemover.releaseFile();
+    return ExitStatus;
+  }
+  if (Error E = writeFileAtomically(
+          Output + ".tmp%%%%%%%%", Output,
+          StringRef((const char *)_BufferOut.data(), _BufferOut.size()))) {
+    errs() << toString(std::move(E)) << "\n";
+    return 1;
+  }
+  return ExitStatus;
+}
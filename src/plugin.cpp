@@ -0,0 +1,144 @@
+//===---- plugin.cpp - Extraction of rose DNA as a clang plugin -----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  Extracts the DNA while the translation unit is compiled, next to the
+//  object file, instead of parsing the sources again with rose-dna:
+//
+//    clang -fplugin=RoseDNAPlugin.so \
+//          -fplugin-arg-rose-dna-header-list=dna-headers.txt -c a.c -o a.o
+//
+//  writes a.o.dna, rose-dna-merge then combines the fragments of every object
+//  in the final DNA. Arguments:
+//
+//    header-list=<file>  only extract the typedefs of the headers listed in
+//                        file, one per line.
+//    out=<file>          write the fragment in file instead of <object>.dna.
+//
+//===----------------------------------------------------------------------===//
+
+#include "dna.h"
+#include "headerlist.h"
+#include "layout.h"
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendPluginRegistry.h"
+#include "llvm/Support/FileUtilities.h"
+
+#include <cstring>
+
+using namespace clang;
+using namespace llvm;
+
+namespace {
+/** Extracts the typedefs like rose-dna does and writes the fragment once the
+ * translation unit is complete. */
+class FragmentConsumer : public TopLevelConsumer {
+public:
+  FragmentConsumer(CompilerInstance &CI, std::string Output,
+                   std::unique_ptr<StringSet<>> Headers)
+      : TopLevelConsumer(&Typedefs), CI(CI), Output(std::move(Output)),
+        Headers(std::move(Headers)), Typedefs(&DNA, this->Headers.get()) {
+    memset(&DNA, 0, sizeof(SDNA));
+  }
+
+  ~FragmentConsumer() override { DNA_free(&DNA); }
+
+  void HandleTranslationUnit(ASTContext &Context) override {
+    TopLevelConsumer::HandleTranslationUnit(Context);
+    if (CI.getDiagnostics().hasErrorOccurred()) {
+      return;
+    }
+
+    std::vector<unsigned char> _BufferOut;
+    DNA_write(&DNA, _BufferOut);
+    if (Error E = writeFileAtomically(
+            Output + ".tmp%%%%%%%%", Output,
+            StringRef((const char *)_BufferOut.data(), _BufferOut.size()))) {
+      unsigned ID = CI.getDiagnostics().getCustomDiagID(
+          DiagnosticsEngine::Error, "failed to write the DNA fragment %0: %1");
+      CI.getDiagnostics().Report(ID) << Output << toString(std::move(E));
+    }
+  }
+
+private:
+  CompilerInstance &CI;
+  std::string Output;
+  std::unique_ptr<StringSet<>> Headers;
+  SDNA DNA;
+  TypedefExtractor Typedefs;
+};
+
+class FragmentAction : public PluginASTAction {
+protected:
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
+                                                 StringRef InFile) override {
+    std::string Fragment = Output;
+    if (Fragment.empty()) {
+      /** Next to the object, or next to the source when there is no object
+       * like with -fsyntax-only. */
+      StringRef Object = CI.getFrontendOpts().OutputFile;
+      Fragment = (Object.empty() || Object == "-" ? InFile : Object).str();
+      Fragment += ".dna";
+    }
+
+    std::unique_ptr<StringSet<>> Headers;
+    if (!HeaderList.empty()) {
+      Headers = std::make_unique<StringSet<>>();
+      if (!readHeaders(CI, *Headers)) {
+        return nullptr;
+      }
+    }
+    return std::make_unique<FragmentConsumer>(CI, Fragment, std::move(Headers));
+  }
+
+  bool ParseArgs(const CompilerInstance &CI,
+                 const std::vector<std::string> &Args) override {
+    for (const std::string &Arg : Args) {
+      StringRef Value = Arg;
+      if (Value.consume_front("header-list=")) {
+        HeaderList = Value.str();
+      } else if (Value.consume_front("out=")) {
+        Output = Value.str();
+      } else {
+        unsigned ID = CI.getDiagnostics().getCustomDiagID(
+            DiagnosticsEngine::Error, "unknown rose-dna plugin argument '%0'");
+        CI.getDiagnostics().Report(ID) << Arg;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /** The compile goes on as usual, the DNA is extracted on the side. */
+  ActionType getActionType() override { return AddAfterMainAction; }
+
+private:
+  /** Same format as --header-list of rose-dna. */
+  bool readHeaders(CompilerInstance &CI, StringSet<> &Headers) {
+    auto List = readHeaderList(HeaderList);
+    if (!List) {
+      unsigned ID = CI.getDiagnostics().getCustomDiagID(
+          DiagnosticsEngine::Error, "%0");
+      CI.getDiagnostics().Report(ID) << toString(List.takeError());
+      return false;
+    }
+    for (const std::string &Header : *List) {
+      Headers.insert(Header);
+    }
+    return true;
+  }
+
+  std::string HeaderList;
+  std::string Output;
+};
+} // end anonymous namespace
+
+static FrontendPluginRegistry::Add<FragmentAction>
+    X("rose-dna", "write the rose DNA of the translation unit next to its "
+                  "object");
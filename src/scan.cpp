@@ -0,0 +1,203 @@
+//===---- scan.cpp - Translation units that include the DNA headers -------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "scan.h"
+#include "trace.h"
+
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/DependencyScanning/DependencyScanningService.h"
+#include "clang/Tooling/DependencyScanning/DependencyScanningTool.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <mutex>
+
+using namespace clang::tooling;
+using namespace clang::tooling::dependencies;
+using namespace llvm;
+
+/** Split the Make rule printed by the dependency scanner, the target is
+ * dropped. Spaces in paths are escaped and long rules are continued on the
+ * next line. */
+static std::vector<std::string> ParseMakeRule(StringRef Rule) {
+  std::vector<std::string> Words;
+  std::string Word;
+  bool Target = true;
+
+  auto Flush = [&]() {
+    if (Word.empty()) {
+      return;
+    }
+    if (Target) {
+      Target = Word.back() != ':';
+    } else {
+      Words.push_back(Word);
+    }
+    Word.clear();
+  };
+
+  for (size_t Index = 0; Index < Rule.size(); Index++) {
+    char C = Rule[Index];
+    if (C == '\\' && Index + 1 < Rule.size()) {
+      char Next = Rule[Index + 1];
+      if (Next == '\n' || Next == '\r') {
+        Flush();
+        Index++;
+        continue;
+      }
+      if (Next == ' ' || Next == '#' || Next == '\\') {
+        Word.push_back(Next);
+        Index++;
+        continue;
+      }
+    }
+    if (C == '$' && Index + 1 < Rule.size() && Rule[Index + 1] == '$') {
+      Word.push_back('$');
+      Index++;
+      continue;
+    }
+    if (C == ' ' || C == '\t' || C == '\n' || C == '\r') {
+      Flush();
+      continue;
+    }
+    Word.push_back(C);
+  }
+  Flush();
+  return Words;
+}
+
+DNAScanner::DNAScanner(const CompilationDatabase &Compilations)
+    : Compilations(Compilations) {}
+
+std::vector<std::string> DNAScanner::select(ArrayRef<std::string> Files,
+                                            const StringSet<> &Headers) {
+  /** The service caches the minimized files, it is shared by the workers. */
+  DependencyScanningService Service(ScanningMode::MinimizedSourcePreprocessing,
+                                    ScanningOutputFormat::Make);
+
+  /** Index of the included DNA headers of each translation unit. */
+  std::vector<std::string> HeaderNames;
+  for (const auto &Header : Headers) {
+    HeaderNames.push_back(Header.getKey().str());
+  }
+  std::sort(HeaderNames.begin(), HeaderNames.end());
+  StringMap<unsigned> HeaderIndices;
+  for (unsigned Index = 0; Index < HeaderNames.size(); Index++) {
+    HeaderIndices[HeaderNames[Index]] = Index;
+  }
+
+  /** The build writes its own dependency files and objects, the scan must
+   * not. */
+  ArgumentsAdjuster Adjuster =
+      combineAdjusters(getClangStripOutputAdjuster(),
+                       getClangStripDependencyFileAdjuster());
+
+  std::vector<std::vector<unsigned>> Included(Files.size());
+  /** Not a vector<bool>, the workers write next to each other. */
+  std::vector<char> Unscanned(Files.size(), 0);
+  std::mutex ErrorMutex;
+
+  {
+    llvm::ThreadPool Pool(llvm::hardware_concurrency(Threads));
+    for (size_t Index = 0; Index < Files.size(); Index++) {
+      Pool.async([&, Index]() {
+        TimeTraceTask Task;
+        llvm::TimeTraceScope Scope("Scan", Files[Index]);
+        DependencyScanningTool Tool(Service);
+        std::vector<unsigned> &Found = Included[Index];
+        for (const CompileCommand &Command :
+             Compilations.getCompileCommands(Files[Index])) {
+          auto Rule = Tool.getDependencyFile(
+              Adjuster(Command.CommandLine, Command.Filename),
+              Command.Directory);
+          if (!Rule) {
+            /** The translation unit is kept, the frontend reports why. */
+            std::lock_guard<std::mutex> Lock(ErrorMutex);
+            llvm::errs() << "Failed to scan " << Files[Index] << ": "
+                         << llvm::toString(Rule.takeError()) << "\n";
+            Unscanned[Index] = 1;
+            return;
+          }
+          for (const std::string &Dependency : ParseMakeRule(*Rule)) {
+            SmallString<256> Path(Dependency);
+            llvm::sys::fs::make_absolute(Command.Directory, Path);
+            llvm::sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+            auto It = HeaderIndices.find(Path);
+            if (It != HeaderIndices.end()) {
+              Found.push_back(It->second);
+            }
+          }
+        }
+        std::sort(Found.begin(), Found.end());
+        Found.erase(std::unique(Found.begin(), Found.end()), Found.end());
+      });
+    }
+    Pool.wait();
+  }
+
+  /** Greedy set cover: take the translation unit including the most headers
+   * not included yet, the first one in the order of \a Files on a tie. It is
+   * at most a logarithmic factor away from the smallest cover. The ones that
+   * could not be scanned are always parsed. */
+  std::vector<bool> Covered(HeaderNames.size(), false);
+  std::vector<bool> Selected(Files.size(), false);
+  Including = 0;
+  for (size_t Index = 0; Index < Files.size(); Index++) {
+    Selected[Index] = Unscanned[Index] != 0;
+    if (Selected[Index] || !Included[Index].empty()) {
+      Including++;
+    }
+  }
+
+  while (true) {
+    size_t Best = Files.size();
+    unsigned BestCount = 0;
+    for (size_t Index = 0; Index < Files.size(); Index++) {
+      if (Selected[Index]) {
+        continue;
+      }
+      unsigned Count = 0;
+      for (unsigned Header : Included[Index]) {
+        if (!Covered[Header]) {
+          Count++;
+        }
+      }
+      if (Count > BestCount) {
+        Best = Index;
+        BestCount = Count;
+      }
+    }
+    if (Best == Files.size()) {
+      break;
+    }
+    Selected[Best] = true;
+    for (unsigned Header : Included[Best]) {
+      Covered[Header] = true;
+    }
+  }
+
+  Uncovered.clear();
+  for (unsigned Index = 0; Index < HeaderNames.size(); Index++) {
+    if (!Covered[Index]) {
+      Uncovered.push_back(HeaderNames[Index]);
+    }
+  }
+
+  std::vector<std::string> Result;
+  for (size_t Index = 0; Index < Files.size(); Index++) {
+    if (Selected[Index]) {
+      Result.push_back(Files[Index]);
+    }
+  }
+  return Result;
+}
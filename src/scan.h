@@ -0,0 +1,46 @@
+//===---- scan.h - Translation units that include the DNA headers ---------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_SCAN_H
+#define ROSE_DNA_SCAN_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <string>
+#include <vector>
+
+/** Finds the translation units worth parsing for a header set without parsing
+ * them. The includes of each translation unit are found by the dependency
+ * scanner of clang, which only preprocesses a minimized version of the
+ * sources, then a small subset of the translation units including every
+ * header at least once is picked. */
+class DNAScanner {
+public:
+  DNAScanner(const clang::tooling::CompilationDatabase &Compilations);
+
+  /** Number of worker threads, 0 uses every hardware thread. */
+  unsigned Threads = 0;
+
+  /** The files of \a Files to parse so that each of \a Headers (absolute
+   * paths) is included at least once, in the order of \a Files. */
+  std::vector<std::string> select(llvm::ArrayRef<std::string> Files,
+                                  const llvm::StringSet<> &Headers);
+
+  /** Translation units of the last select() that include one of the headers
+   * at least. */
+  unsigned Including = 0;
+  /** Headers of the last select() that no translation unit includes. */
+  std::vector<std::string> Uncovered;
+
+private:
+  const clang::tooling::CompilationDatabase &Compilations;
+};
+
+#endif // ROSE_DNA_SCAN_H
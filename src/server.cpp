@@ -0,0 +1,214 @@
+//===---- server.cpp - Resident rose-dna answering on a local socket ------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "server.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+
+/** Requests are a single short line. */
+static const size_t RequestMaxLen = 4096;
+
+/** Seconds a client has to send its request and read the answer, a client
+ * that does neither would hold every other one back. */
+static const int ClientTimeout = 5;
+
+#if !defined(_WIN32)
+/** A client that goes away before reading its answer must not kill the
+ * server with SIGPIPE, macOS has SO_NOSIGPIPE instead. */
+#if defined(MSG_NOSIGNAL)
+static const int SendFlags = MSG_NOSIGNAL;
+#else
+static const int SendFlags = 0;
+#endif
+#endif
+
+DNAServer::DNAServer(const std::string &SocketPath, ExtractFn Extract)
+    : SocketPath(SocketPath), Extract(std::move(Extract)), Running(false) {
+  memset(&DNA, 0, sizeof(SDNA));
+}
+
+DNAServer::~DNAServer() { DNA_free(&DNA); }
+
+std::string DNAServer::handle(StringRef Request) {
+  Request = Request.trim();
+
+  if (Request == "extract") {
+    auto Start = std::chrono::steady_clock::now();
+
+    SDNA Fresh;
+    memset(&Fresh, 0, sizeof(SDNA));
+    std::string Summary;
+    bool Success = Extract(&Fresh, Summary);
+    DNA_free(&DNA);
+    DNA = Fresh;
+
+    double Seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - Start)
+                         .count();
+    std::string Answer;
+    raw_string_ostream OS(Answer);
+    OS << (Success ? "ok " : "error ") << Summary
+       << format(" in %.3fs\n", Seconds);
+    return OS.str();
+  }
+
+  if (Request.startswith("lookup ")) {
+    StringRef Name = Request.drop_front(strlen("lookup ")).trim();
+    for (const DNAStruct *Struct = DNA._Types;
+         Struct != DNA._Types + DNA._TypesLen; ++Struct) {
+      if (Name != DNA_string(&DNA, Struct->name)) {
+        continue;
+      }
+
+      std::string Answer;
+      raw_string_ostream OS(Answer);
+      OS << "struct " << Name << " " << Struct->size << " "
+         << Struct->_FieldsLen << "\n";
+      const DNAField *Fields = DNA_struct_fields(&DNA, Struct);
+      for (const DNAField *Field = Fields; Field != Fields + Struct->_FieldsLen;
+           ++Field) {
+        OS << DNA_string(&DNA, Field->name) << "\t"
+           << DNA_string(&DNA, Field->type) << "\t" << Field->offset << "\t"
+           << Field->size << "\t" << Field->align << "\t" << Field->array
+           << "\t" << Field->flags << "\n";
+      }
+      return OS.str();
+    }
+    return "error no struct " + Name.str() + "\n";
+  }
+
+  if (Request == "shutdown") {
+    Running = false;
+    return "ok\n";
+  }
+
+  return "error unknown request\n";
+}
+
+int DNAServer::serve() {
+#if defined(_WIN32)
+  errs() << "The server needs Unix domain sockets.\n";
+  return 1;
+#else
+  sockaddr_un Address;
+  memset(&Address, 0, sizeof(Address));
+  Address.sun_family = AF_UNIX;
+  if (SocketPath.size() >= sizeof(Address.sun_path)) {
+    errs() << "The socket path " << SocketPath << " is too long.\n";
+    return 1;
+  }
+  memcpy(Address.sun_path, SocketPath.c_str(), SocketPath.size());
+
+  /** A socket left behind by a server that did not shut down cleanly. */
+  sys::fs::file_status Status;
+  if (!sys::fs::status(SocketPath, Status) &&
+      Status.type() == sys::fs::file_type::socket_file) {
+    unlink(SocketPath.c_str());
+  }
+
+  /** Only the user running the server may connect to it, the socket is
+   * created without any permission for the others. */
+  int Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  mode_t Mask = umask(0077);
+  bool Bound = Socket >= 0 && bind(Socket, (const sockaddr *)&Address,
+                                   sizeof(Address)) == 0;
+  umask(Mask);
+  if (!Bound || listen(Socket, 16) != 0) {
+    errs() << "Failed to listen on " << SocketPath << ": " << strerror(errno)
+           << "\n";
+    if (Socket >= 0) {
+      close(Socket);
+    }
+    return 1;
+  }
+
+  /** The first request is already warm. */
+  errs() << handle("extract");
+
+  int ExitStatus = 0;
+  Running = true;
+  while (Running) {
+    int Client = accept(Socket, nullptr, nullptr);
+    if (Client < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      errs() << "Failed to accept a connection: " << strerror(errno) << "\n";
+      ExitStatus = 1;
+      break;
+    }
+#if defined(SO_NOSIGPIPE)
+    int NoSigPipe = 1;
+    setsockopt(Client, SOL_SOCKET, SO_NOSIGPIPE, &NoSigPipe,
+               sizeof(NoSigPipe));
+#endif
+    timeval Timeout = {ClientTimeout, 0};
+    setsockopt(Client, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+    setsockopt(Client, SOL_SOCKET, SO_SNDTIMEO, &Timeout, sizeof(Timeout));
+
+    std::string Request;
+    char Buffer[256];
+    bool TimedOut = false;
+    while (Request.size() < RequestMaxLen &&
+           Request.find('\n') == std::string::npos) {
+      ssize_t Len = read(Client, Buffer, sizeof(Buffer));
+      if (Len < 0 && errno == EINTR) {
+        continue;
+      }
+      if (Len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        TimedOut = true;
+      }
+      if (Len <= 0) {
+        break;
+      }
+      Request.append(Buffer, Len);
+    }
+    if (TimedOut) {
+      /** Whatever came is not handled, it may be half of a request. */
+      close(Client);
+      continue;
+    }
+
+    std::string Answer = handle(StringRef(Request).split('\n').first);
+    const char *Itr = Answer.c_str();
+    size_t Left = Answer.size();
+    while (Left > 0) {
+      ssize_t Len = send(Client, Itr, Left, SendFlags);
+      if (Len < 0 && errno == EINTR) {
+        continue;
+      }
+      if (Len <= 0) {
+        break;
+      }
+      Itr += Len;
+      Left -= Len;
+    }
+    close(Client);
+  }
+
+  close(Socket);
+  unlink(SocketPath.c_str());
+  return ExitStatus;
+#endif
+}
@@ -0,0 +1,57 @@
+//===---- server.h - Resident rose-dna answering on a local socket --------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_SERVER_H
+#define ROSE_DNA_SERVER_H
+
+#include "dna.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <functional>
+#include <string>
+
+/** Keeps rose-dna resident and answers requests on a Unix domain socket that
+ * only its user may connect to. Each connection sends a single request line
+ * and reads the answer until the server closes it, a client that takes more
+ * than a few seconds to do either is dropped:
+ *
+ *   extract       extract and write the DNA again, only the translation units
+ *                 whose inputs changed are parsed. Answers "ok <summary>".
+ *   lookup NAME   layout of the struct NAME in the last extracted DNA, a
+ *                 "struct <name> <size> <fields>" line then one tab separated
+ *                 line per field: name, type, offset, size, align, array and
+ *                 flags.
+ *   shutdown      stop the server.
+ *
+ * Failures answer "error <reason>". */
+class DNAServer {
+public:
+  /** Extract and write the DNA, hand its main table in \a DNA and a short
+   * description of the run in \a Summary. */
+  typedef std::function<bool(SDNA *DNA, std::string &Summary)> ExtractFn;
+
+  DNAServer(const std::string &SocketPath, ExtractFn Extract);
+  ~DNAServer();
+
+  /** Extract once then serve requests until a shutdown request, returns the
+   * exit status of rose-dna, non zero when the socket could not be bound,
+   * listened on or accepted from. */
+  int serve();
+
+private:
+  std::string handle(llvm::StringRef Request);
+
+  std::string SocketPath;
+  ExtractFn Extract;
+
+  SDNA DNA;
+  bool Running;
+};
+
+#endif // ROSE_DNA_SERVER_H
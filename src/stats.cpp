@@ -0,0 +1,167 @@
+//===---- stats.cpp - Statistics of an extraction -------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "stats.h"
+
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace llvm;
+
+/** Peak resident set size of the process in bytes, 0 when unknown. */
+static uint64_t PeakResidentSize() {
+#if defined(__linux__) || defined(__APPLE__)
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage) == 0) {
+#if defined(__APPLE__)
+    return (uint64_t)Usage.ru_maxrss;
+#else
+    return (uint64_t)Usage.ru_maxrss * 1024;
+#endif
+  }
+#endif
+  return 0;
+}
+
+void DNAStats::recordUnit(const DNAUnitStats &Unit) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  Units.push_back(Unit);
+}
+
+void DNAStats::recordPhase(StringRef Phase, double Seconds) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  for (auto &Entry : Phases) {
+    if (Entry.first == Phase) {
+      Entry.second += Seconds;
+      return;
+    }
+  }
+  Phases.emplace_back(Phase.str(), Seconds);
+}
+
+void DNAStats::recordOutput(StringRef Path, uint64_t Bytes, const SDNA *DNA) {
+  unsigned Fields = 0;
+  for (const DNAStruct *Struct = DNA->_Types;
+       Struct != DNA->_Types + DNA->_TypesLen; ++Struct) {
+    Fields += Struct->_FieldsLen;
+  }
+  std::lock_guard<std::mutex> Lock(Mutex);
+  Outputs.push_back({Path.str(), Bytes, (unsigned)DNA->_TypesLen, Fields});
+}
+
+static void WriteTypedefs(json::OStream &J, const TypedefStats &Typedefs) {
+  J.attributeObject("typedefs", [&]() {
+    J.attribute("matched", Typedefs.Implicit + Typedefs.OutsideHeaders +
+                               Typedefs.NotRecord + Typedefs.Builtin +
+                               Typedefs.Duplicate + Typedefs.Accepted);
+    J.attribute("accepted", Typedefs.Accepted);
+    J.attributeObject("skipped", [&]() {
+      J.attribute("implicit", Typedefs.Implicit);
+      J.attribute("outside_headers", Typedefs.OutsideHeaders);
+      J.attribute("not_record", Typedefs.NotRecord);
+      J.attribute("builtin", Typedefs.Builtin);
+      J.attribute("duplicate", Typedefs.Duplicate);
+    });
+    J.attribute("fields", Typedefs.Fields);
+  });
+}
+
+/** The totals come first, the translation units last sorted by path. */
+bool DNAStats::write(StringRef Path) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+
+  std::vector<const DNAUnitStats *> Sorted;
+  TypedefStats Total;
+  unsigned Cached = 0;
+  for (const DNAUnitStats &Unit : Units) {
+    Sorted.push_back(&Unit);
+    if (Unit.Cached) {
+      Cached++;
+      continue;
+    }
+    Total.Implicit += Unit.Typedefs.Implicit;
+    Total.OutsideHeaders += Unit.Typedefs.OutsideHeaders;
+    Total.NotRecord += Unit.Typedefs.NotRecord;
+    Total.Builtin += Unit.Typedefs.Builtin;
+    Total.Duplicate += Unit.Typedefs.Duplicate;
+    Total.Accepted += Unit.Typedefs.Accepted;
+    Total.Fields += Unit.Typedefs.Fields;
+  }
+  std::sort(Sorted.begin(), Sorted.end(),
+            [](const DNAUnitStats *A, const DNAUnitStats *B) {
+              return A->File < B->File;
+            });
+
+  std::string Buffer;
+  raw_string_ostream OS(Buffer);
+  {
+    json::OStream J(OS, /*IndentSize=*/2);
+    J.objectBegin();
+    J.attributeObject("translation_units", [&]() {
+      J.attribute("visited", (int64_t)Units.size());
+      J.attribute("parsed", (int64_t)(Units.size() - Cached));
+      J.attribute("cached", Cached);
+    });
+    WriteTypedefs(J, Total);
+
+    J.attributeArray("outputs", [&]() {
+      for (const Output &Entry : Outputs) {
+        J.object([&]() {
+          J.attribute("path", Entry.Path);
+          J.attribute("bytes", (int64_t)Entry.Bytes);
+          J.attribute("structs", Entry.Structs);
+          J.attribute("fields", Entry.Fields);
+        });
+      }
+    });
+
+    J.attributeObject("phases", [&]() {
+      for (const auto &Entry : Phases) {
+        J.attribute(Entry.first, Entry.second);
+      }
+    });
+
+    uint64_t PeakRSS = PeakResidentSize();
+    if (PeakRSS) {
+      J.attribute("peak_rss_bytes", (int64_t)PeakRSS);
+    } else {
+      J.attribute("peak_rss_bytes", nullptr);
+    }
+
+    J.attributeArray("units", [&]() {
+      for (const DNAUnitStats *Unit : Sorted) {
+        J.object([&]() {
+          J.attribute("file", Unit->File);
+          J.attribute("cached", Unit->Cached);
+          J.attribute("seconds", Unit->Seconds);
+          if (!Unit->Cached) {
+            J.attribute("ast_bytes", (int64_t)Unit->ASTBytes);
+            WriteTypedefs(J, Unit->Typedefs);
+          }
+        });
+      }
+    });
+    J.objectEnd();
+  }
+  OS << "\n";
+  OS.flush();
+
+  if (Error E = writeFileAtomically((Path + ".tmp%%%%%%%%").str(), Path,
+                                    Buffer)) {
+    consumeError(std::move(E));
+    return false;
+  }
+  return true;
+}
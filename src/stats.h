@@ -0,0 +1,78 @@
+//===---- stats.h - Statistics of an extraction ---------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_STATS_H
+#define ROSE_DNA_STATS_H
+
+#include "dna.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** What TypedefExtractor did with the typedefs it was handed, each typedef
+ * is counted once. */
+typedef struct TypedefStats {
+  /** Implicit typedefs of clang, they have no location. */
+  unsigned Implicit = 0;
+  /** Declared outside of the DNA headers. */
+  unsigned OutsideHeaders = 0;
+  /** Typedefs of anything but a record. */
+  unsigned NotRecord = 0;
+  /** Typedefs of the builtin records of clang. */
+  unsigned Builtin = 0;
+  /** Another typedef of a record that was already extracted. */
+  unsigned Duplicate = 0;
+  /** Typedefs that became a struct, and the fields of these structs. */
+  unsigned Accepted = 0;
+  unsigned Fields = 0;
+} TypedefStats;
+
+/** What happened to a single translation unit. */
+typedef struct DNAUnitStats {
+  std::string File;
+  /** Replayed from the cache, nothing else is known then. */
+  bool Cached = false;
+  double Seconds = 0.0;
+  /** Memory allocated by the ASTContext of the translation unit. */
+  uint64_t ASTBytes = 0;
+  TypedefStats Typedefs;
+} DNAUnitStats;
+
+/** Statistics of an extraction, written as JSON by --stats. The translation
+ * units are recorded by the worker threads. */
+class DNAStats {
+public:
+  void recordUnit(const DNAUnitStats &Unit);
+  /** Add \a Seconds to the time of \a Phase. */
+  void recordPhase(llvm::StringRef Phase, double Seconds);
+  /** \a Path was written with \a Bytes bytes from \a DNA. */
+  void recordOutput(llvm::StringRef Path, uint64_t Bytes, const SDNA *DNA);
+
+  /** Write the statistics and the peak resident set size of the process in
+   * \a Path. */
+  bool write(llvm::StringRef Path) const;
+
+private:
+  struct Output {
+    std::string Path;
+    uint64_t Bytes;
+    unsigned Structs;
+    unsigned Fields;
+  };
+
+  mutable std::mutex Mutex;
+  std::vector<DNAUnitStats> Units;
+  /** In the order they first ran. */
+  std::vector<std::pair<std::string, double>> Phases;
+  std::vector<Output> Outputs;
+};
+
+#endif // ROSE_DNA_STATS_H
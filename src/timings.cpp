@@ -0,0 +1,96 @@
+//===---- timings.cpp - Frontend time of each translation unit ------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "timings.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+/** One "<seconds> <path>" line per translation unit. */
+bool DNATimings::load(StringRef Path) {
+  auto Buffer = MemoryBuffer::getFile(Path);
+  if (!Buffer) {
+    return Buffer.getError() == std::errc::no_such_file_or_directory;
+  }
+
+  std::lock_guard<std::mutex> Lock(Mutex);
+  SmallVector<StringRef, 64> Lines;
+  (*Buffer)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty=*/false);
+  for (StringRef Line : Lines) {
+    std::pair<StringRef, StringRef> Entry = Line.split(' ');
+    double Value;
+    if (Entry.second.empty() || Entry.first.getAsDouble(Value)) {
+      continue;
+    }
+    Seconds[Entry.second] = Value;
+  }
+  return true;
+}
+
+bool DNATimings::save(StringRef Path) const {
+  std::string History;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    std::vector<StringRef> Files;
+    for (const auto &Entry : Seconds) {
+      Files.push_back(Entry.getKey());
+    }
+    std::sort(Files.begin(), Files.end());
+
+    raw_string_ostream OS(History);
+    for (StringRef File : Files) {
+      OS << format("%.6f ", Seconds.lookup(File)) << File << "\n";
+    }
+  }
+
+  if (Error E = writeFileAtomically((Path + ".tmp%%%%%%%%").str(), Path,
+                                    History)) {
+    consumeError(std::move(E));
+    return false;
+  }
+  return true;
+}
+
+void DNATimings::record(StringRef File, double FileSeconds) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  Seconds[File] = FileSeconds;
+}
+
+std::vector<size_t> DNATimings::schedule(ArrayRef<std::string> Files) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+
+  double Longest = 0.0;
+  std::vector<double> Expected(Files.size(), -1.0);
+  for (size_t Index = 0; Index < Files.size(); Index++) {
+    auto It = Seconds.find(Files[Index]);
+    if (It != Seconds.end()) {
+      Expected[Index] = It->second;
+      Longest = std::max(Longest, It->second);
+    }
+  }
+
+  std::vector<size_t> Order(Files.size());
+  for (size_t Index = 0; Index < Files.size(); Index++) {
+    Order[Index] = Index;
+    if (Expected[Index] < 0.0) {
+      Expected[Index] = Longest;
+    }
+  }
+  std::stable_sort(Order.begin(), Order.end(), [&](size_t A, size_t B) {
+    return Expected[A] > Expected[B];
+  });
+  return Order;
+}
@@ -0,0 +1,44 @@
+//===---- timings.h - Frontend time of each translation unit --------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_TIMINGS_H
+#define ROSE_DNA_TIMINGS_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** How long the frontend took on each translation unit in the previous runs,
+ * kept in a small history file given by --timings or in the cache directory.
+ * It is only used to order the work, a missing or stale history costs nothing
+ * but balance. */
+class DNATimings {
+public:
+  /** Read the history of \a Path, a missing file is an empty history. */
+  bool load(llvm::StringRef Path);
+  /** Write the history in \a Path, the timings of the files that were not
+   * extracted this time are kept. */
+  bool save(llvm::StringRef Path) const;
+
+  void record(llvm::StringRef File, double Seconds);
+
+  /** Indices of \a Files, longest processing time first. A file without a
+   * timing yet is expected to be as long as the longest known one so that it
+   * does not end up last, ties keep the order of \a Files. */
+  std::vector<size_t> schedule(llvm::ArrayRef<std::string> Files) const;
+
+private:
+  mutable std::mutex Mutex;
+  llvm::StringMap<double> Seconds;
+};
+
+#endif // ROSE_DNA_TIMINGS_H
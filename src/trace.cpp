@@ -0,0 +1,60 @@
+//===---- trace.cpp - Time trace of the extraction ------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "trace.h"
+
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+
+using namespace llvm;
+
+/** What the worker threads need to start their own profiler, set once before
+ * any task runs. */
+static std::atomic<bool> Tracing{false};
+static unsigned TraceGranularity;
+static std::string TraceProcessName;
+
+TimeTraceSession::TimeTraceSession(const std::string &Path,
+                                   unsigned Granularity, StringRef ProcessName)
+    : Path(Path) {
+  if (Path.empty()) {
+    return;
+  }
+  TraceGranularity = Granularity;
+  TraceProcessName = ProcessName.str();
+  timeTraceProfilerInitialize(Granularity, ProcessName);
+  Tracing = true;
+}
+
+TimeTraceSession::~TimeTraceSession() {
+  if (Path.empty()) {
+    return;
+  }
+  Tracing = false;
+  if (Error E = timeTraceProfilerWrite(Path, Path)) {
+    errs() << "Failed to write the time trace in " << Path << ": "
+           << toString(std::move(E)) << "\n";
+  }
+  timeTraceProfilerCleanup();
+}
+
+/** A task running on the thread of the session is already traced. */
+TimeTraceTask::TimeTraceTask()
+    : Started(Tracing && !timeTraceProfilerEnabled()) {
+  if (Started) {
+    timeTraceProfilerInitialize(TraceGranularity, TraceProcessName);
+  }
+}
+
+TimeTraceTask::~TimeTraceTask() {
+  if (Started) {
+    timeTraceProfilerFinishThread();
+  }
+}
@@ -0,0 +1,43 @@
+//===---- trace.h - Time trace of the extraction --------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_TRACE_H
+#define ROSE_DNA_TRACE_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+/** Traces rose-dna with the LLVM time trace profiler from its construction to
+ * its destruction, the trace is then written in Chrome trace JSON. Nothing is
+ * traced when the path is empty. */
+class TimeTraceSession {
+public:
+  /** Events shorter than \a Granularity microseconds are dropped, like with
+   * clang -ftime-trace-granularity. */
+  TimeTraceSession(const std::string &Path, unsigned Granularity,
+                   llvm::StringRef ProcessName);
+  ~TimeTraceSession();
+
+private:
+  std::string Path;
+};
+
+/** Traces a task of a worker thread when rose-dna is traced. The profiler is
+ * per thread and a thread pool does not tell when its threads exit, so the
+ * events of each task are handed over to the trace when the task ends. */
+class TimeTraceTask {
+public:
+  TimeTraceTask();
+  ~TimeTraceTask();
+
+private:
+  bool Started;
+};
+
+#endif // ROSE_DNA_TRACE_H
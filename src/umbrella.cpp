@@ -0,0 +1,104 @@
+//===---- umbrella.cpp - Single translation unit over a set of headers ----===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "umbrella.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+using namespace clang::tooling;
+using namespace llvm;
+
+namespace {
+/** Compilation database that only knows the command of the umbrella. */
+class UmbrellaCompilationDatabase : public CompilationDatabase {
+public:
+  UmbrellaCompilationDatabase(CompileCommand Command)
+      : Command(std::move(Command)) {}
+
+  std::vector<CompileCommand>
+  getCompileCommands(StringRef FilePath) const override {
+    if (FilePath != Command.Filename) {
+      return {};
+    }
+    return {Command};
+  }
+
+  std::vector<std::string> getAllFiles() const override {
+    return {Command.Filename};
+  }
+
+  std::vector<CompileCommand> getAllCompileCommands() const override {
+    return {Command};
+  }
+
+private:
+  CompileCommand Command;
+};
+} // end anonymous namespace
+
+static std::string MakeAbsolute(const Twine &Directory, StringRef Path) {
+  SmallString<256> Absolute(Path);
+  sys::fs::make_absolute(Directory, Absolute);
+  sys::path::remove_dots(Absolute, /*remove_dot_dot=*/true);
+  return std::string(Absolute.str());
+}
+
+Expected<UmbrellaUnit>
+createUmbrellaUnit(const CompilationDatabase &Compilations,
+                   StringRef Representative, ArrayRef<std::string> Headers) {
+  SmallString<256> Current;
+  sys::fs::current_path(Current);
+
+  std::vector<CompileCommand> Commands =
+      Compilations.getCompileCommands(MakeAbsolute(Current, Representative));
+  if (Commands.empty()) {
+    return make_error<StringError>("No compile command for " + Representative,
+                                   inconvertibleErrorCode());
+  }
+  CompileCommand Command = Commands.front();
+
+  UmbrellaUnit Unit;
+  SmallString<256> Path(Command.Directory);
+  sys::path::append(Path, "rose-dna-umbrella" +
+                              sys::path::extension(Command.Filename));
+  Unit.Path = MakeAbsolute(Current, Path);
+
+  for (const std::string &Header : Headers) {
+    Unit.Contents += "#include \"" + MakeAbsolute(Current, Header) + "\"\n";
+  }
+
+  /** Compile the umbrella in place of the representative file, everything
+   * else on the command line (defines, include paths, target) is kept. */
+  std::string Filename = MakeAbsolute(Command.Directory, Command.Filename);
+  std::vector<std::string> CommandLine;
+  bool Replaced = false;
+  for (size_t Index = 0; Index < Command.CommandLine.size(); Index++) {
+    const std::string &Argument = Command.CommandLine[Index];
+    if (Index > 0 && Argument[0] != '-' &&
+        MakeAbsolute(Command.Directory, Argument) == Filename) {
+      if (!Replaced) {
+        CommandLine.push_back(Unit.Path);
+        Replaced = true;
+      }
+      continue;
+    }
+    CommandLine.push_back(Argument);
+  }
+  if (!Replaced) {
+    CommandLine.push_back(Unit.Path);
+  }
+
+  Command.Filename = Unit.Path;
+  Command.CommandLine = std::move(CommandLine);
+  Command.Output.clear();
+  Unit.Compilations =
+      std::make_unique<UmbrellaCompilationDatabase>(std::move(Command));
+  return std::move(Unit);
+}
@@ -0,0 +1,38 @@
+//===---- umbrella.h - Single translation unit over a set of headers ------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_UMBRELLA_H
+#define ROSE_DNA_UMBRELLA_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/** A translation unit that only exists in memory and includes a set of
+ * headers, it is compiled with the command of another file. */
+typedef struct UmbrellaUnit {
+  /** Absolute path of the umbrella, it is never written on disk. */
+  std::string Path;
+  std::string Contents;
+  /** Holds the compile command of the umbrella only. */
+  std::unique_ptr<clang::tooling::CompilationDatabase> Compilations;
+} UmbrellaUnit;
+
+/** Build the umbrella of \a Headers, compiled with the command of
+ * \a Representative in \a Compilations. */
+llvm::Expected<UmbrellaUnit>
+createUmbrellaUnit(const clang::tooling::CompilationDatabase &Compilations,
+                   llvm::StringRef Representative,
+                   llvm::ArrayRef<std::string> Headers);
+
+#endif // ROSE_DNA_UMBRELLA_H
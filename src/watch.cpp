@@ -0,0 +1,148 @@
+//===---- watch.cpp - Notifications of changes to the DNA headers ---------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "watch.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+
+DNAWatcher::DNAWatcher() : FD(-1) {}
+
+DNAWatcher::~DNAWatcher() {
+#if defined(__linux__)
+  if (FD >= 0) {
+    close(FD);
+  }
+#endif
+}
+
+bool DNAWatcher::init() {
+#if defined(__linux__)
+  FD = inotify_init1(IN_CLOEXEC);
+  return FD >= 0;
+#else
+  return false;
+#endif
+}
+
+bool DNAWatcher::watch(ArrayRef<std::string> NewFiles) {
+#if defined(__linux__)
+  Files.clear();
+  StringSet<> NewDirectories;
+  for (const std::string &File : NewFiles) {
+    Files.insert(File);
+    NewDirectories.insert(sys::path::parent_path(File));
+  }
+
+  /** Drop the directories no file lives in anymore. */
+  for (auto It = Descriptors.begin(); It != Descriptors.end();) {
+    if (NewDirectories.count(It->second)) {
+      ++It;
+      continue;
+    }
+    inotify_rm_watch(FD, It->first);
+    Directories.erase(It->second);
+    It = Descriptors.erase(It);
+  }
+
+  bool Success = true;
+  for (const auto &Directory : NewDirectories) {
+    StringRef Path = Directory.getKey();
+    if (Directories.count(Path)) {
+      continue;
+    }
+    int WD = inotify_add_watch(FD, Path.str().c_str(),
+                               IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE |
+                                   IN_DELETE);
+    if (WD < 0) {
+      errs() << "Failed to watch " << Path << "\n";
+      Success = false;
+      continue;
+    }
+    Directories[Path] = WD;
+    Descriptors.push_back({WD, Path.str()});
+  }
+  return Success;
+#else
+  return false;
+#endif
+}
+
+bool DNAWatcher::read(StringSet<> &Changed) {
+#if defined(__linux__)
+  alignas(struct inotify_event) char Buffer[4096];
+  ssize_t Len = ::read(FD, Buffer, sizeof(Buffer));
+  if (Len < 0) {
+    return errno == EINTR || errno == EAGAIN;
+  }
+
+  for (char *Itr = Buffer; Itr < Buffer + Len;) {
+    const struct inotify_event *Event = (const struct inotify_event *)Itr;
+    Itr += sizeof(struct inotify_event) + Event->len;
+    if (Event->len == 0) {
+      continue;
+    }
+
+    auto Descriptor =
+        std::find_if(Descriptors.begin(), Descriptors.end(),
+                     [Event](const std::pair<int, std::string> &Entry) {
+                       return Entry.first == Event->wd;
+                     });
+    if (Descriptor == Descriptors.end()) {
+      continue;
+    }
+    SmallString<256> Path(Descriptor->second);
+    sys::path::append(Path, Event->name);
+    if (Files.count(Path)) {
+      Changed.insert(Path);
+    }
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::vector<std::string> DNAWatcher::wait(int SettleMs) {
+  StringSet<> Changed;
+#if defined(__linux__)
+  struct pollfd Poll = {FD, POLLIN, 0};
+  while (Changed.empty()) {
+    if (poll(&Poll, 1, -1) < 0 && errno != EINTR) {
+      break;
+    }
+    if ((Poll.revents & POLLIN) && !read(Changed)) {
+      break;
+    }
+  }
+  while (!Changed.empty() && poll(&Poll, 1, SettleMs) > 0) {
+    if (!read(Changed)) {
+      break;
+    }
+  }
+#endif
+
+  std::vector<std::string> Result;
+  for (const auto &File : Changed) {
+    Result.push_back(File.getKey().str());
+  }
+  std::sort(Result.begin(), Result.end());
+  return Result;
+}
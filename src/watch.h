@@ -0,0 +1,52 @@
+//===---- watch.h - Notifications of changes to the DNA headers -----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_WATCH_H
+#define ROSE_DNA_WATCH_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <string>
+#include <vector>
+
+/** Waits for files to change with inotify. The directories of the files are
+ * watched rather than the files themselves, editors often save by replacing
+ * the file which would drop a watch on the file. */
+class DNAWatcher {
+public:
+  DNAWatcher();
+  ~DNAWatcher();
+
+  /** Returns false when inotify can not be used. */
+  bool init();
+
+  /** Watch \a Files from now on instead of the previous ones, the paths are
+   * absolute. */
+  bool watch(llvm::ArrayRef<std::string> Files);
+
+  /** Block until at least one watched file changed and return the changed
+   * files. The changes that follow within \a SettleMs are returned with it,
+   * an editor saving a file often touches it several times. */
+  std::vector<std::string> wait(int SettleMs = 100);
+
+private:
+  /** Read the pending events, add the watched files they touch to
+   * \a Changed. */
+  bool read(llvm::StringSet<> &Changed);
+
+  int FD;
+  /** Watch descriptor of each watched directory. */
+  llvm::StringMap<int> Directories;
+  /** Directory of each watch descriptor. */
+  std::vector<std::pair<int, std::string>> Descriptors;
+  llvm::StringSet<> Files;
+};
+
+#endif // ROSE_DNA_WATCH_H
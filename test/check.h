@@ -0,0 +1,28 @@
+//===---- check.h - Assertions of the rose DNA tests ----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_TEST_CHECK_H
+#define ROSE_DNA_TEST_CHECK_H
+
+#include <stdio.h>
+
+/** Number of failed checks, the exit status of the test. */
+static int Failures = 0;
+
+/** Report a failed check and keep going, so that a run lists every
+ * failure. */
+#define CHECK(Condition)                                                       \
+  do {                                                                         \
+    if (!(Condition)) {                                                        \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,         \
+              #Condition);                                                     \
+      Failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+#endif // ROSE_DNA_TEST_CHECK_H
@@ -0,0 +1,249 @@
+//===---- dna_reader_test.cpp - The in place reader of the DNA ------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  Writes indexed DNA files with DNA_write_indexed(), maps them with the
+//  reader of dna_reader.h and checks every struct, field and type against the
+//  SDNA they were written from. Truncated and corrupt files must be rejected
+//  or read without going out of the file.
+//
+//===----------------------------------------------------------------------===//
+
+#include "check.h"
+#include "sample.h"
+
+#include "dna.h"
+#include "dna_reader.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+typedef std::vector<unsigned char> Buffer;
+
+/** A copy of \a Bytes at an address aligned like a mapping. */
+class AlignedCopy {
+public:
+  AlignedCopy(const Buffer &Bytes)
+      : Words((Bytes.size() + 7) / 8 + 1), Size(Bytes.size()) {
+    if (Size) {
+      memcpy(data(), Bytes.data(), Size);
+    }
+  }
+  unsigned char *data() { return (unsigned char *)Words.data(); }
+  size_t size() const { return Size; }
+
+private:
+  std::vector<uint64_t> Words;
+  size_t Size;
+};
+
+/** The view of \a Target holds the structs of \a DNA in place. */
+static void CheckView(const DNAView *View, const SDNA *DNA) {
+  CHECK(DNA_view_structs_len(View) == (uint32_t)DNA->_TypesLen);
+  for (int Index = 0; Index < DNA->_TypesLen; Index++) {
+    const DNAStruct *Struct = &DNA->_Types[Index];
+    const char *Name = DNA_string(DNA, Struct->name);
+    const DNAFileStruct *FileStruct = DNA_view_find_struct(View, Name);
+    CHECK(FileStruct != NULL);
+    if (!FileStruct) {
+      continue;
+    }
+    CHECK(FileStruct == DNA_view_struct(View, Index));
+    CHECK(DNA_view_struct_index(View, FileStruct) == (uint32_t)Index);
+    CHECK(strcmp(DNA_view_string(View, FileStruct->name), Name) == 0);
+    CHECK(FileStruct->size == Struct->size);
+    CHECK(FileStruct->fields_len == (uint32_t)Struct->_FieldsLen);
+
+    const DNAField *Fields = DNA_struct_fields(DNA, Struct);
+    for (int FieldIndex = 0; FieldIndex < Struct->_FieldsLen; FieldIndex++) {
+      const DNAField *Field = &Fields[FieldIndex];
+      const char *FieldName = DNA_string(DNA, Field->name);
+      const DNAFileField *FileField =
+          DNA_view_field(View, FileStruct, FieldIndex);
+      CHECK(FileField != NULL);
+      if (!FileField) {
+        continue;
+      }
+      CHECK(FileField == DNA_view_find_field(View, FileStruct, FieldName));
+      CHECK(strcmp(DNA_view_string(View, FileField->type),
+                   DNA_string(DNA, Field->type)) == 0);
+      CHECK(FileField->offset == Field->offset);
+      CHECK(FileField->size == Field->size);
+      CHECK(FileField->align == Field->align);
+      CHECK(FileField->array == Field->array);
+      CHECK(FileField->flags == (uint32_t)Field->flags);
+
+      const DNAFileType *FileType = DNA_view_field_type(View, FileField);
+      if (Field->type_id < 0) {
+        CHECK(FileType == NULL);
+        continue;
+      }
+      const DNAType *Type = &DNA->_TypeTable[Field->type_id];
+      CHECK(FileType != NULL);
+      if (!FileType) {
+        continue;
+      }
+      CHECK(FileType->kind == (uint32_t)Type->kind);
+      CHECK(FileType->size == Type->size);
+      CHECK(strcmp(DNA_view_string(View, FileType->name),
+                   DNA_string(DNA, Type->name)) == 0);
+      const DNAFileStruct *Referred = DNA_view_type_struct(View, FileType);
+      if (Type->kind != DNA_TYPE_STRUCT || Type->index < 0) {
+        CHECK(Referred == NULL);
+      } else {
+        CHECK(Referred == DNA_view_struct(View, Type->index));
+      }
+    }
+    CHECK(DNA_view_field(View, FileStruct, Struct->_FieldsLen) == NULL);
+    CHECK(DNA_view_find_field(View, FileStruct, "none") == NULL);
+  }
+  CHECK(DNA_view_struct(View, DNA->_TypesLen) == NULL);
+  CHECK(DNA_view_find_struct(View, "struct None") == NULL);
+}
+
+static void CheckFile(DNAFile *File, const std::vector<DNATarget> &Targets) {
+  CHECK(File->targets_len == Targets.size());
+  for (uint32_t Target = 0; Target < Targets.size(); Target++) {
+    DNAView View;
+    CHECK(DNA_file_view(File, Target, &View));
+    CHECK(Targets[Target].Triple == View.triple);
+    CheckView(&View, &Targets[Target].DNA);
+  }
+  DNAView View;
+  CHECK(!DNA_file_view(File, (uint32_t)Targets.size(), &View));
+}
+
+/** Read everything \a File points to, whatever it holds. */
+static void WalkFile(const DNAFile *File) {
+  for (uint32_t Target = 0; Target < File->targets_len && Target < 8;
+       Target++) {
+    DNAView View;
+    if (!DNA_file_view(File, Target, &View)) {
+      continue;
+    }
+    for (uint32_t Index = 0; Index < DNA_view_structs_len(&View); Index++) {
+      const DNAFileStruct *Struct = DNA_view_struct(&View, Index);
+      const char *Name = DNA_view_string(&View, Struct->name);
+      if (Name) {
+        DNA_view_find_struct(&View, Name);
+      }
+      for (uint32_t Field = 0; Field < Struct->fields_len; Field++) {
+        const DNAFileField *FileField = DNA_view_field(&View, Struct, Field);
+        if (!FileField) {
+          break;
+        }
+        DNA_view_string(&View, FileField->name);
+        DNA_view_string(&View, FileField->type);
+        const DNAFileType *Type = DNA_view_field_type(&View, FileField);
+        if (Type) {
+          DNA_view_string(&View, Type->name);
+          DNA_view_type_struct(&View, Type);
+        }
+      }
+    }
+  }
+}
+
+static void TestMemory() {
+  for (int TargetsLen : {0, 1, 3}) {
+    for (bool FirstEmpty : {true, false}) {
+      std::vector<DNATarget> Targets = SampleTargets(TargetsLen, FirstEmpty);
+      Buffer Bytes;
+      DNA_write_indexed(Targets, Bytes);
+      AlignedCopy Copy(Bytes);
+      DNAFile File;
+      CHECK(DNA_file_open_memory(&File, Copy.data(), Copy.size()));
+      CheckFile(&File, Targets);
+      DNA_file_close(&File);
+
+      /** The entries are read in place, they must be aligned. */
+      std::vector<uint64_t> Words(Bytes.size() / 8 + 2);
+      unsigned char *Unaligned = (unsigned char *)Words.data() + 4;
+      memcpy(Unaligned, Bytes.data(), Bytes.size());
+      CHECK(!DNA_file_open_memory(&File, Unaligned, Bytes.size()));
+      FreeTargets(Targets);
+    }
+  }
+}
+
+static void TestFile() {
+  const char *Path = "rose-dna-reader-test.dna";
+  std::vector<DNATarget> Targets = SampleTargets(2, false);
+  Buffer Bytes;
+  DNA_write_indexed(Targets, Bytes);
+  FILE *Out = fopen(Path, "wb");
+  CHECK(Out != NULL);
+  if (Out) {
+    fwrite(Bytes.data(), 1, Bytes.size(), Out);
+    fclose(Out);
+  }
+  DNAFile File;
+  CHECK(DNA_file_open(&File, Path));
+  CheckFile(&File, Targets);
+  DNA_file_close(&File);
+
+  /** The legacy stream is not read. */
+  Bytes.clear();
+  DNA_write_targets(Targets, Bytes);
+  Out = fopen(Path, "wb");
+  CHECK(Out != NULL);
+  if (Out) {
+    fwrite(Bytes.data(), 1, Bytes.size(), Out);
+    fclose(Out);
+  }
+  CHECK(!DNA_file_open(&File, Path));
+  remove(Path);
+  CHECK(!DNA_file_open(&File, Path));
+  FreeTargets(Targets);
+}
+
+static void TestBroken() {
+  std::vector<DNATarget> Targets = SampleTargets(2, false);
+  Buffer Bytes;
+  DNA_write_indexed(Targets, Bytes);
+
+  for (size_t Size = 0; Size < Bytes.size(); Size++) {
+    AlignedCopy Prefix(Buffer(Bytes.begin(), Bytes.begin() + Size));
+    DNAFile File;
+    if (DNA_file_open_memory(&File, Prefix.data(), Prefix.size())) {
+      fprintf(stderr, "truncated at %zu of %zu bytes\n", Size, Bytes.size());
+      CHECK(false);
+    }
+  }
+
+  /** The magic, the version and the byte order. */
+  for (size_t Word = 0; Word < 3; Word++) {
+    AlignedCopy Copy(Bytes);
+    Copy.data()[Word * 4] ^= 0xff;
+    DNAFile File;
+    CHECK(!DNA_file_open_memory(&File, Copy.data(), Copy.size()));
+  }
+
+  AlignedCopy Copy(Bytes);
+  for (size_t Byte = 0; Byte < Copy.size(); Byte++) {
+    for (int Bit = 0; Bit < 8; Bit++) {
+      Copy.data()[Byte] ^= 1 << Bit;
+      DNAFile File;
+      if (DNA_file_open_memory(&File, Copy.data(), Copy.size())) {
+        WalkFile(&File);
+        DNA_file_close(&File);
+      }
+      Copy.data()[Byte] ^= 1 << Bit;
+    }
+  }
+  FreeTargets(Targets);
+}
+
+int main() {
+  TestMemory();
+  TestFile();
+  TestBroken();
+  return Failures ? 1 : 0;
+}
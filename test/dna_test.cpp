@@ -0,0 +1,329 @@
+//===---- dna_test.cpp - Round trips of the rose DNA formats --------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  Writes the legacy DNA, with and without targets or a struct at a time, and
+//  the indexed DNA, reads them back with DNA_read() and DNAStream, and checks
+//  that truncated or corrupt buffers are rejected.
+//
+//===----------------------------------------------------------------------===//
+
+#include "check.h"
+#include "sample.h"
+
+#include "dna.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+typedef std::vector<unsigned char> Buffer;
+
+/** What the type of \a Field resolves to, comparable across SDNAs. */
+static std::string TypeOf(const SDNA *DNA, const DNAField *Field) {
+  if (Field->type_id < 0) {
+    return "unknown";
+  }
+  const DNAType *Type = &DNA->_TypeTable[Field->type_id];
+  std::string Result = std::to_string(Type->kind) + " " +
+                       DNA_string(DNA, Type->name) + " " +
+                       std::to_string(Type->size);
+  if (Type->kind != DNA_TYPE_STRUCT) {
+    return Result + " " + std::to_string(Type->index);
+  }
+  if (Type->index < 0) {
+    return Result + " not held";
+  }
+  return Result + " -> " + DNA_string(DNA, DNA->_Types[Type->index].name);
+}
+
+/** Same structs in the same order, with the same layouts and types. */
+static bool SameDNA(const SDNA *A, const SDNA *B) {
+  if (A->_TypesLen != B->_TypesLen) {
+    return false;
+  }
+  for (int Index = 0; Index < A->_TypesLen; Index++) {
+    const DNAStruct *StructA = &A->_Types[Index];
+    const DNAStruct *StructB = &B->_Types[Index];
+    if (strcmp(DNA_string(A, StructA->name), DNA_string(B, StructB->name)) ||
+        DNA_struct_fingerprint(A, StructA) !=
+            DNA_struct_fingerprint(B, StructB)) {
+      return false;
+    }
+    const DNAField *FieldsA = DNA_struct_fields(A, StructA);
+    const DNAField *FieldsB = DNA_struct_fields(B, StructB);
+    for (int Field = 0; Field < StructA->_FieldsLen; Field++) {
+      if (TypeOf(A, &FieldsA[Field]) != TypeOf(B, &FieldsB[Field])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/** Read \a Bytes with DNA_read() in \a DNA, which is emptied first. */
+static bool ReadDNA(const Buffer &Bytes, SDNA *DNA) {
+  DNA_free(DNA);
+  return DNA_read(DNA, Bytes.data(), Bytes.size());
+}
+
+/** Read every struct of \a Bytes with a DNAStream into \a DNA, which is
+ * emptied first. */
+static bool StreamDNA(const Buffer &Bytes, SDNA *DNA) {
+  DNA_free(DNA);
+  DNAStream Stream(Bytes.data(), Bytes.size());
+  if (!Stream.begin()) {
+    return false;
+  }
+  SDNA Struct;
+  memset(&Struct, 0, sizeof(SDNA));
+  while (Stream.next(&Struct)) {
+    DNA_copy_struct(DNA, &Struct, &Struct._Types[0]);
+  }
+  DNA_free(&Struct);
+  DNA_resolve_types(DNA);
+  return !Stream.failed();
+}
+
+/** Both readers give back \a Expected from \a Bytes. */
+static void CheckReadsBack(const Buffer &Bytes, const SDNA *Expected) {
+  SDNA DNA;
+  memset(&DNA, 0, sizeof(SDNA));
+  CHECK(ReadDNA(Bytes, &DNA));
+  CHECK(SameDNA(&DNA, Expected));
+  CHECK(StreamDNA(Bytes, &DNA));
+  CHECK(SameDNA(&DNA, Expected));
+  DNAStream Sorted(Bytes.data(), Bytes.size());
+  CHECK(Sorted.sorted());
+  DNA_free(&DNA);
+}
+
+/** Every shorter buffer is rejected by both readers but the ones of
+ * \a Valid, the lengths at which the buffer still is a DNA. */
+static void CheckTruncated(const Buffer &Bytes,
+                           const std::vector<size_t> &Valid) {
+  SDNA DNA;
+  memset(&DNA, 0, sizeof(SDNA));
+  for (size_t Size = 0; Size < Bytes.size(); Size++) {
+    bool IsValid = std::find(Valid.begin(), Valid.end(), Size) != Valid.end();
+    Buffer Prefix(Bytes.begin(), Bytes.begin() + Size);
+    if (ReadDNA(Prefix, &DNA) != IsValid ||
+        StreamDNA(Prefix, &DNA) != IsValid) {
+      fprintf(stderr, "truncated at %zu of %zu bytes\n", Size, Bytes.size());
+      CHECK(false);
+    }
+  }
+  DNA_free(&DNA);
+}
+
+/** Flip every bit of \a Bytes in turn, the readers must not crash. */
+static void CheckCorrupt(const Buffer &Bytes) {
+  SDNA DNA;
+  memset(&DNA, 0, sizeof(SDNA));
+  Buffer Copy = Bytes;
+  for (size_t Byte = 0; Byte < Copy.size(); Byte++) {
+    for (int Bit = 0; Bit < 8; Bit++) {
+      Copy[Byte] ^= 1 << Bit;
+      ReadDNA(Copy, &DNA);
+      StreamDNA(Copy, &DNA);
+      Copy[Byte] ^= 1 << Bit;
+    }
+  }
+  DNA_free(&DNA);
+}
+
+/** "SDNA", the number of structs and the structs, where the legacy stream
+ * of DNA_write() can stop. */
+static size_t StructsSize(const SDNA *DNA) {
+  Buffer Bytes;
+  WriteWordOut(Bytes, "SDNA");
+  WriteIntOut(Bytes, DNA->_TypesLen);
+  for (const DNAStruct *Struct = DNA->_Types;
+       Struct != DNA->_Types + DNA->_TypesLen; ++Struct) {
+    DNA_write_struct(DNA, Struct, Bytes);
+  }
+  return Bytes.size();
+}
+
+static void TestLegacy() {
+  for (int StructsLen : {0, 1, 5}) {
+    SDNA DNA;
+    memset(&DNA, 0, sizeof(SDNA));
+    FillDNA(&DNA, StructsLen, 0);
+    Buffer Bytes;
+    DNA_write(&DNA, Bytes);
+    CheckReadsBack(Bytes, &DNA);
+
+    /** Written before the types existed, the fields are not resolved. */
+    size_t Structs = StructsSize(&DNA);
+    Buffer Untyped(Bytes.begin(), Bytes.begin() + Structs);
+    SDNA Old;
+    memset(&Old, 0, sizeof(SDNA));
+    CHECK(DNA_read(&Old, Untyped.data(), Untyped.size()));
+    CHECK(Old._TypesLen == DNA._TypesLen);
+    for (int Field = 0; Field < Old._FieldsLen; Field++) {
+      CHECK(Old._Fields[Field].type_id == -1);
+    }
+    DNA_free(&Old);
+
+    CheckTruncated(Bytes, {Structs});
+    CheckCorrupt(Bytes);
+    DNA_free(&DNA);
+  }
+}
+
+static void TestLegacyCorrupt() {
+  SDNA DNA;
+  memset(&DNA, 0, sizeof(SDNA));
+  FillDNA(&DNA, 3, 0);
+  Buffer Bytes;
+  DNA_write(&DNA, Bytes);
+  SDNA Read;
+  memset(&Read, 0, sizeof(SDNA));
+
+  Buffer Copy = Bytes;
+  Copy[0] = 'X';
+  CHECK(!ReadDNA(Copy, &Read));
+  CHECK(!StreamDNA(Copy, &Read));
+
+  /** A negative number of structs. */
+  Copy = Bytes;
+  int Negative = -1;
+  memcpy(&Copy[4], &Negative, sizeof(int));
+  CHECK(!ReadDNA(Copy, &Read));
+  CHECK(!StreamDNA(Copy, &Read));
+
+  /** The last field refers to a type past the end of the types. */
+  Copy = Bytes;
+  int Past = DNA._TypeTableLen;
+  memcpy(&Copy[Copy.size() - sizeof(int)], &Past, sizeof(int));
+  CHECK(!ReadDNA(Copy, &Read));
+  CHECK(!StreamDNA(Copy, &Read));
+
+  /** Trailing bytes are not part of a DNA. */
+  Copy = Bytes;
+  Copy.push_back(0);
+  CHECK(!ReadDNA(Copy, &Read));
+  CHECK(!StreamDNA(Copy, &Read));
+
+  DNA_free(&Read);
+  DNA_free(&DNA);
+}
+
+static void TestLegacyTargets() {
+  for (bool FirstEmpty : {true, false}) {
+    std::vector<DNATarget> Targets = SampleTargets(3, FirstEmpty);
+    Buffer Bytes;
+    DNA_write_targets(Targets, Bytes);
+    /** The first target is the DNA, the "TRGT" section is not read. */
+    CheckReadsBack(Bytes, &Targets.front().DNA);
+
+    /** Cut at the end of the structs, of the types or anywhere in the
+     * "TRGT" section, the first target is still whole. */
+    Buffer First;
+    DNA_write(&Targets.front().DNA, First);
+    std::vector<size_t> Valid = {StructsSize(&Targets.front().DNA),
+                                 First.size()};
+    for (size_t Size = First.size() + 4; Size < Bytes.size(); Size++) {
+      Valid.push_back(Size);
+    }
+    CheckTruncated(Bytes, Valid);
+    CheckCorrupt(Bytes);
+    FreeTargets(Targets);
+  }
+}
+
+static void TestStreamWriter() {
+  for (int StructsLen : {0, 1, 5}) {
+    SDNA DNA;
+    memset(&DNA, 0, sizeof(SDNA));
+    FillDNA(&DNA, StructsLen, 0);
+
+    /** Written and emptied a struct at a time, like rose-dna-merge does. */
+    DNAStreamWriter Writer;
+    Buffer Chunk, Bytes;
+    Writer.begin(Chunk);
+    SDNA Copy;
+    memset(&Copy, 0, sizeof(SDNA));
+    for (int Index = 0; Index < DNA._TypesLen; Index++) {
+      Bytes.insert(Bytes.end(), Chunk.begin(), Chunk.end());
+      Chunk.clear();
+      CHECK(Writer.add(&DNA, &DNA._Types[Index], Chunk));
+      DNA_copy_struct(&Copy, &DNA, &DNA._Types[Index]);
+    }
+    int Count = Writer.finish(Chunk);
+    Bytes.insert(Bytes.end(), Chunk.begin(), Chunk.end());
+    CHECK(Count == StructsLen);
+    memcpy(&Bytes[DNAStreamWriter::CountOffset], &Count, sizeof(int));
+
+    /** The same bytes as DNA_write() of the structs in that order. */
+    DNA_resolve_types(&Copy);
+    Buffer Expected;
+    DNA_write(&Copy, Expected);
+    CHECK(Bytes == Expected);
+    CheckReadsBack(Bytes, &DNA);
+    DNA_free(&Copy);
+    DNA_free(&DNA);
+  }
+}
+
+static void TestIndexed() {
+  SDNA DNA;
+  memset(&DNA, 0, sizeof(SDNA));
+
+  /** No target at all is a valid file but holds no DNA. */
+  std::vector<DNATarget> None;
+  Buffer Bytes;
+  DNA_write_indexed(None, Bytes);
+  CHECK(!ReadDNA(Bytes, &DNA));
+  CHECK(!StreamDNA(Bytes, &DNA));
+
+  for (int TargetsLen : {1, 3}) {
+    for (bool FirstEmpty : {true, false}) {
+      std::vector<DNATarget> Targets = SampleTargets(TargetsLen, FirstEmpty);
+      Bytes.clear();
+      DNA_write_indexed(Targets, Bytes);
+      /** The first target is the DNA. */
+      CheckReadsBack(Bytes, &Targets.front().DNA);
+      CheckTruncated(Bytes, {});
+      CheckCorrupt(Bytes);
+
+      /** The same DNA is written the same way. */
+      Buffer Again;
+      DNA_write_indexed(Targets, Again);
+      CHECK(Again == Bytes);
+      FreeTargets(Targets);
+    }
+  }
+
+  std::vector<DNATarget> Targets = SampleTargets(2, false);
+  Bytes.clear();
+  DNA_write_indexed(Targets, Bytes);
+  const char *Fields[] = {"magic", "version", "byte order"};
+  for (size_t Field = 0; Field < 3; Field++) {
+    Buffer Copy = Bytes;
+    Copy[Field * 4] ^= 0xff;
+    CHECK(!ReadDNA(Copy, &DNA));
+    if (StreamDNA(Copy, &DNA)) {
+      fprintf(stderr, "a wrong %s is accepted\n", Fields[Field]);
+      CHECK(false);
+    }
+  }
+  FreeTargets(Targets);
+  DNA_free(&DNA);
+}
+
+int main() {
+  TestLegacy();
+  TestLegacyCorrupt();
+  TestLegacyTargets();
+  TestStreamWriter();
+  TestIndexed();
+  return Failures ? 1 : 0;
+}
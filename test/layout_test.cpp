@@ -0,0 +1,172 @@
+//===---- layout_test.cpp - The structs clang lays out --------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  Extracts the DNA of small translation units with TypedefExtractor and
+//  checks that the fields of a record type resolve to the struct the DNA
+//  holds for that record, however the record and the field are spelled.
+//
+//===----------------------------------------------------------------------===//
+
+#include "check.h"
+
+#include "dna.h"
+#include "layout.h"
+
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <string.h>
+
+#include <memory>
+#include <string>
+
+namespace {
+/** Hands the translation unit to a TopLevelConsumer, like rose-dna does. */
+class LayoutAction : public clang::ASTFrontendAction {
+public:
+  LayoutAction(TypedefExtractor *Typedefs) : Typedefs(Typedefs) {}
+
+protected:
+  std::unique_ptr<clang::ASTConsumer>
+  CreateASTConsumer(clang::CompilerInstance &CI,
+                    llvm::StringRef File) override {
+    return std::make_unique<TopLevelConsumer>(Typedefs);
+  }
+
+private:
+  TypedefExtractor *Typedefs;
+};
+} // end anonymous namespace
+
+/** Extract the DNA of \a Code in \a DNA, only from \a Headers when given.
+ * \a Files are mapped in memory next to \a FileName. */
+static bool Extract(SDNA *DNA, const std::string &Code, const char *FileName,
+                    const llvm::StringSet<> *Headers = nullptr,
+                    const clang::tooling::FileContentMappings &Files = {}) {
+  TypedefExtractor Typedefs(DNA, Headers);
+  bool Success = clang::tooling::runToolOnCodeWithArgs(
+      std::make_unique<LayoutAction>(&Typedefs), Code, {"-fsyntax-only"},
+      FileName, "rose-dna-layout-test",
+      std::make_shared<clang::PCHContainerOperations>(), Files);
+  DNA_resolve_types(DNA);
+  return Success;
+}
+
+static const DNAStruct *FindStruct(const SDNA *DNA, const char *Name) {
+  for (const DNAStruct *Struct = DNA->_Types;
+       Struct != DNA->_Types + DNA->_TypesLen; ++Struct) {
+    if (strcmp(DNA_string(DNA, Struct->name), Name) == 0) {
+      return Struct;
+    }
+  }
+  return NULL;
+}
+
+/** The struct of \a DNA the field \a Name of \a Struct has the type of, NULL
+ * when it is not a struct the DNA holds. */
+static const DNAStruct *FieldStruct(const SDNA *DNA, const DNAStruct *Struct,
+                                    const char *Name) {
+  const DNAField *Fields = DNA_struct_fields(DNA, Struct);
+  for (int Field = 0; Field < Struct->_FieldsLen; Field++) {
+    if (strcmp(DNA_string(DNA, Fields[Field].name), Name) != 0) {
+      continue;
+    }
+    if (Fields[Field].type_id < 0) {
+      return NULL;
+    }
+    const DNAType *Type = &DNA->_TypeTable[Fields[Field].type_id];
+    if (Type->kind != DNA_TYPE_STRUCT || Type->index < 0) {
+      return NULL;
+    }
+    return &DNA->_Types[Type->index];
+  }
+  return NULL;
+}
+
+/** The record through a typedef, a pointer, an array or its own typedef. */
+static void TestC() {
+  SDNA DNA;
+  memset(&DNA, 0, sizeof(SDNA));
+  CHECK(Extract(&DNA,
+                "struct X { int a; };\n"
+                "typedef struct X XT;\n"
+                "typedef struct { int b; } Anon;\n"
+                "typedef struct Y {\n"
+                "  struct X x; XT *p; XT a[2]; Anon n;\n"
+                "} YT;\n",
+                "input.c"));
+  const DNAStruct *X = FindStruct(&DNA, "struct X");
+  const DNAStruct *Y = FindStruct(&DNA, "struct Y");
+  CHECK(X != NULL && Y != NULL);
+  if (X && Y) {
+    CHECK(FieldStruct(&DNA, Y, "x") == X);
+    CHECK(FieldStruct(&DNA, Y, "p") == X);
+    CHECK(FieldStruct(&DNA, Y, "a") == X);
+    const DNAStruct *Anon = FieldStruct(&DNA, Y, "n");
+    CHECK(Anon != NULL && Anon != X && Anon != Y);
+  }
+  DNA_free(&DNA);
+}
+
+/** Records of a namespace, named with and without their scope. */
+static void TestNamespace() {
+  SDNA DNA;
+  memset(&DNA, 0, sizeof(SDNA));
+  CHECK(Extract(&DNA,
+                "namespace n {\n"
+                "struct A { int a; };\n"
+                "typedef A AT;\n"
+                "struct B { A a; AT *p; n::A q; };\n"
+                "typedef struct B BT;\n"
+                "}\n",
+                "input.cc"));
+  CHECK(DNA._TypesLen == 2);
+  for (const DNAStruct *B = DNA._Types; B != DNA._Types + DNA._TypesLen;
+       ++B) {
+    if (B->_FieldsLen != 3) {
+      continue;
+    }
+    const DNAStruct *A = FieldStruct(&DNA, B, "a");
+    CHECK(A != NULL && A != B);
+    CHECK(FieldStruct(&DNA, B, "p") == A);
+    CHECK(FieldStruct(&DNA, B, "q") == A);
+  }
+  DNA_free(&DNA);
+}
+
+/** The first typedef of a record the DNA takes is a typedef of a typedef
+ * declared outside of the headers. */
+static void TestTypedefOfTypedef() {
+  SDNA DNA;
+  memset(&DNA, 0, sizeof(SDNA));
+  llvm::StringSet<> Headers;
+  Headers.insert("/rose-dna-test/input.c");
+  CHECK(Extract(&DNA,
+                "#include \"outside.h\"\n"
+                "typedef XT XT2;\n"
+                "typedef struct Y { XT2 x; struct X *p; } YT;\n",
+                "/rose-dna-test/input.c", &Headers,
+                {{"/rose-dna-test/outside.h",
+                  "typedef struct X { int a; } XT;\n"}}));
+  const DNAStruct *X = FindStruct(&DNA, "struct X");
+  const DNAStruct *Y = FindStruct(&DNA, "struct Y");
+  CHECK(X != NULL && Y != NULL);
+  if (X && Y) {
+    CHECK(FieldStruct(&DNA, Y, "x") == X);
+    CHECK(FieldStruct(&DNA, Y, "p") == X);
+  }
+  DNA_free(&DNA);
+}
+
+int main() {
+  TestC();
+  TestNamespace();
+  TestTypedefOfTypedef();
+  return Failures ? 1 : 0;
+}
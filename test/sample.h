@@ -0,0 +1,87 @@
+//===---- sample.h - DNA the rose DNA tests write and read ----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ROSE_DNA_TEST_SAMPLE_H
+#define ROSE_DNA_TEST_SAMPLE_H
+
+#include "dna.h"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+/** Fill \a DNA with \a StructsLen structs, sorted. Each has a primitive
+ * field, a pointer to another struct of the DNA, a struct the DNA does not
+ * hold and a field of unknown type, \a Salt changes the layouts. */
+static void FillDNA(SDNA *DNA, int StructsLen, int Salt) {
+  for (int Index = 0; Index < StructsLen; Index++) {
+    DNAStruct *Struct =
+        DNA_add_struct(DNA, "struct S" + std::to_string(Index));
+    Struct->size = 32 + 8 * Index + Salt;
+
+    DNAField *Field = DNA_add_field(DNA, Struct, "value");
+    Field->type = DNA_intern(DNA, "int", 3);
+    Field->type_id =
+        DNA_add_type(DNA, DNA_TYPE_PRIMITIVE, "", 4, DNA_PRIMITIVE_INT32);
+    Field->offset = 0;
+    Field->size = 4;
+    Field->align = 4;
+    Field->array = 1;
+
+    std::string Next = "struct S" + std::to_string((Index + 1) % StructsLen);
+    Field = DNA_add_field(DNA, Struct, "next");
+    Field->type = DNA_intern(DNA, Next.c_str(), Next.size());
+    Field->type_id = DNA_add_type(DNA, DNA_TYPE_STRUCT, Next, 0, -1);
+    Field->offset = 64;
+    Field->size = 8;
+    Field->align = 8;
+    Field->array = 1;
+    Field->flags = DNA_FIELD_IS_POINTER;
+
+    Field = DNA_add_field(DNA, Struct, "missing");
+    Field->type = DNA_intern(DNA, "struct Missing", 14);
+    Field->type_id =
+        DNA_add_type(DNA, DNA_TYPE_STRUCT, "struct Missing", 8, -1);
+    Field->offset = 128;
+    Field->size = 8;
+    Field->align = 4;
+    Field->array = 2;
+    Field->flags = DNA_FIELD_IS_ARRAY;
+
+    Field = DNA_add_field(DNA, Struct, "unknown");
+    Field->type = DNA_intern(DNA, "vector", 6);
+    Field->offset = 192 + Salt;
+    Field->size = 8;
+    Field->align = 8;
+    Field->array = 1;
+  }
+  DNA_sort(DNA);
+}
+
+/** The DNA of \a TargetsLen targets, target \a Index has \a Index + 2
+ * structs but the first one when \a FirstEmpty. */
+static std::vector<DNATarget> SampleTargets(int TargetsLen, bool FirstEmpty) {
+  std::vector<DNATarget> Targets(TargetsLen);
+  for (int Index = 0; Index < TargetsLen; Index++) {
+    memset(&Targets[Index].DNA, 0, sizeof(SDNA));
+    Targets[Index].Triple = Index ? "target" + std::to_string(Index) : "";
+    if (Index > 0 || !FirstEmpty) {
+      FillDNA(&Targets[Index].DNA, Index + 2, Index);
+    }
+  }
+  return Targets;
+}
+
+static void FreeTargets(std::vector<DNATarget> &Targets) {
+  for (DNATarget &Target : Targets) {
+    DNA_free(&Target.DNA);
+  }
+}
+
+#endif // ROSE_DNA_TEST_SAMPLE_H